@@ -0,0 +1,35 @@
+#include "profile.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Count heap allocations for -p. Only the editor links this file, so the benches keep the default
+// operator new, and without -p the only addition to the default behaviour is one flag test.
+void* operator new(size_t n) {
+    if (g_profile) profile_count_allocation();
+    void* p = malloc(n ? n : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t n) {
+    return operator new(n);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
@@ -0,0 +1,45 @@
+// Load benchmark: compares the mapped/SIMD loader with the original getline loader.
+//
+// Usage: bench_load <file> [runs]
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../fileio.h"
+
+using namespace std;
+
+static void report(const char* name, const LoadStats& s) {
+    cout << left << setw(10) << name << right << fixed << setprecision(3)
+         << setw(10) << s.seconds << " s  "
+         << setw(8) << s.gbps() << " GB/s  "
+         << s.lines << " lines" << (s.mapped ? "  (mapped)" : "") << "\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Usage: bench_load <file> [runs]\n";
+        return 1;
+    }
+    string file = argv[1];
+    int runs = argc > 2 ? max(1, atoi(argv[2])) : 3;
+
+    for (int r = 0; r < runs; ++r) {
+        LoadStats fast, base;
+        {
+            TextBuffer buf;
+            if (!load_file(file, buf, &fast)) { cerr << "cannot open " << file << "\n"; return 1; }
+        }
+        {
+            TextBuffer buf;
+            load_file_getline(file, buf, &base);
+        }
+        report("load_file", fast);
+        report("getline", base);
+        if (fast.seconds > 0) cout << "speedup   " << fixed << setprecision(1) << base.seconds / fast.seconds << "x\n";
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Replace benchmark: compares replace_all with replacing one match at a time, the way pressing
+// Enter in the Replace prompt does, and checks that undo and redo of the batch round-trip.
+//
+// Usage: bench_replace [file] [query] [replacement] [runs]
+// Without a file, a synthetic log-like buffer with 100k occurrences of the query is generated.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../fileio.h"
+#include "../undo.h"
+#include "../util.h"
+#include "synthetic.h"
+
+using namespace std;
+
+// What Enter in the Replace prompt does for each match: edit it, then find the next one
+static size_t replace_one_by_one(TextBuffer& buf, const string& q, const string& repl) {
+    size_t count = 0;
+    int row = 0, col = 0;
+    Match m;
+    begin_undo_group(row, col);
+    while (find_next(buf, q, row, col, m) && (m.line > row || (m.line == row && m.start >= col))) {
+        erase_text(buf, m.line, m.start, m.len, row, col);
+        insert_text(buf, m.line, m.start, repl, row, col);
+        row = m.line;
+        col = m.start + (int)repl.size();
+        count++;
+    }
+    end_undo_group();
+    return count;
+}
+
+template <class F>
+static double time_best(int runs, F f) {
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    string q = argc > 2 ? argv[2] : "status=404";
+    string repl = argc > 3 ? argv[3] : "status=410 gone";
+    int runs = argc > 4 ? max(1, atoi(argv[4])) : 3;
+    string original;
+    if (argc > 1 && string(argv[1]) != "-") {
+        TextBuffer file;
+        if (!load_file(argv[1], file)) { cerr << "cannot open " << argv[1] << "\n"; return 1; }
+        original = file.text();
+    } else {
+        original = synthetic_with(100000, q);
+    }
+    set_undo_budget((size_t)1 << 40); // keep the history in memory; spilling is not what is measured
+
+    TextBuffer buf;
+    size_t oldCount = 0, newCount = 0;
+    string oldText, newText;
+    double told = time_best(runs, [&]() {
+        buf.assign(original);
+        oldCount = replace_one_by_one(buf, q, repl);
+    });
+    oldText = buf.text();
+    double tnew = time_best(runs, [&]() {
+        buf.assign(original);
+        newCount = replace_all(buf, q, repl, false, 0, 0);
+    });
+    newText = buf.text();
+
+    int row = 0, col = 0;
+    bool undone = do_undo(buf, row, col) && buf.text() == original;
+    bool redone = do_redo(buf, row, col) && buf.text() == newText;
+    bool same = oldCount == newCount && oldText == newText;
+
+    cout << original.size() / 1e6 << " MB, \"" << q << "\" -> \"" << repl << "\", best of " << runs << "\n";
+    cout << fixed << setprecision(2)
+         << "one by one:  " << setw(10) << told * 1e3 << " ms  (" << oldCount << " replacements)\n"
+         << "replace_all: " << setw(10) << tnew * 1e3 << " ms  (" << newCount << " replacements)\n"
+         << setprecision(1) << "speedup: " << told / tnew << "x"
+         << (same ? "" : "  MISMATCH") << (undone ? "" : "  UNDO FAILED") << (redone ? "" : "  REDO FAILED") << "\n";
+    return same && undone && redone ? 0 : 1;
+}
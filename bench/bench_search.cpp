@@ -0,0 +1,86 @@
+// Search benchmark: compares find_all with the original line-by-line std::string::find version,
+// and with its own serial scan (the "threads" column is the speedup the search threads give).
+//
+// Usage: bench_search [file] [runs]
+// Without a file, a synthetic 64 MB log-like buffer is generated.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../fileio.h"
+#include "../util.h"
+#include "synthetic.h"
+
+using namespace std;
+
+// The original find_all, over a vector of lines
+static vector<Match> find_all_lines(const vector<string>& lines, const string& q) {
+    vector<Match> out;
+    if (q.empty()) return out;
+    for (int i = 0; i < (int)lines.size(); ++i) {
+        const string &ln = lines[i];
+        size_t pos = 0;
+        while (pos < ln.size()) {
+            size_t f = ln.find(q, pos);
+            if (f == string::npos) break;
+            out.push_back(Match{i, (int)f, (int)q.size()});
+            pos = f + q.size();
+        }
+    }
+    return out;
+}
+
+template <class F>
+static double time_best(int runs, F f) {
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int runs = argc > 2 ? max(1, atoi(argv[2])) : 3;
+    TextBuffer buf;
+    if (argc > 1) {
+        if (!load_file(argv[1], buf)) { cerr << "cannot open " << argv[1] << "\n"; return 1; }
+    } else {
+        buf.assign(synthetic(64u << 20));
+    }
+    vector<string> lines;
+    lines.reserve(buf.line_count());
+    for (size_t i = 0; i < buf.line_count(); ++i) lines.push_back(buf.line(i));
+
+    const char* queries[] = {"E", "status", "latency_ms=", "not-present-anywhere",
+                             "connection reset by peer request", "a much longer query that never occurs in the data"};
+    cout << buf.size() / 1e6 << " MB, " << buf.line_count() << " lines, best of " << runs << "\n";
+    cout << left << setw(52) << "query" << right << setw(10) << "matches" << setw(12) << "old ms" << setw(12) << "1 thr ms"
+         << setw(12) << "new ms" << setw(10) << "speedup" << setw(10) << "threads" << "\n";
+    auto same_matches = [](const vector<Match>& a, const vector<Match>& b) {
+        return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), [](const Match& x, const Match& y) {
+            return x.line == y.line && x.start == y.start && x.len == y.len;
+        });
+    };
+    for (const char* q : queries) {
+        vector<Match> a, b, c;
+        double told = time_best(runs, [&]() { a = find_all_lines(lines, q); });
+        g_searchThreads = 1; // the serial scan, to show what the threads add
+        double tserial = time_best(runs, [&]() { c = find_all(buf, q); });
+        g_searchThreads = 0;
+        double tnew = time_best(runs, [&]() { b = find_all(buf, q); });
+        bool same = same_matches(a, b) && same_matches(a, c);
+        cout << left << setw(52) << (string("\"") + q + "\"") << right << setw(10) << b.size()
+             << fixed << setprecision(2) << setw(12) << told * 1e3 << setw(12) << tserial * 1e3 << setw(12) << tnew * 1e3
+             << setprecision(1) << setw(9) << told / tnew << "x" << setprecision(1) << setw(9) << tserial / tnew << "x"
+             << (same ? "" : "  MISMATCH") << "\n";
+        if (!same) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Benchmark suite for the editor's hot paths: load_file (and the first screen of load_file_async),
+// save_file, find_all (several query shapes), editing with undo/redo, and render + screen_flush
+// against a headless terminal (term_null.cpp).
+// Synthetic log-like files from 1 KB up to --max are written to a temporary directory first.
+//
+// Usage: bench_suite [--max SIZE] [--runs N] [--csv] [--dir DIR]
+//   SIZE takes a K, M or G suffix (default 64M; 1G runs every size). Results go to stdout as one
+//   JSON document (or CSV with --csv), one record per operation, case and file size, so runs of
+//   different versions can be compared by a script.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../display.h"
+#include "../fileio.h"
+#include "../undo.h"
+#include "../util.h"
+#include "synthetic.h"
+
+using namespace std;
+
+// Globals the editor code expects from main.cpp
+volatile bool g_ignoreCtrlC = true;
+bool g_showTitle = true;
+bool g_showInfo = true;
+
+extern size_t g_nullCells;
+
+// One line of output
+struct Result {
+    string op;
+    string variant;
+    size_t bytes;  // size of the file the operation ran on
+    int runs;
+    double best;   // seconds
+    double mean;   // seconds
+    size_t count;  // matches, lines, frames... whatever the operation produces
+};
+
+static vector<Result> results;
+
+// Time `f` `runs` times; `f` returns the count to report
+template <class F>
+static void measure(const string& op, const string& variant, size_t bytes, int runs, F f) {
+    double best = 1e30, total = 0;
+    size_t count = 0;
+    for (int r = 0; r < runs; ++r) {
+        auto t0 = chrono::steady_clock::now();
+        count = f();
+        double t = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        best = min(best, t);
+        total += t;
+    }
+    results.push_back(Result{op, variant, bytes, runs, best, total / runs, count});
+    cerr << op << " " << variant << " " << bytes << ": " << best * 1e3 << " ms\n";
+}
+
+static size_t parse_size(const string& s) {
+    size_t n = strtoull(s.c_str(), nullptr, 10);
+    switch (s.empty() ? 0 : s.back()) {
+        case 'K': case 'k': return n << 10;
+        case 'M': case 'm': return n << 20;
+        case 'G': case 'g': return n << 30;
+    }
+    return n;
+}
+
+// Throughput in MB/s for the operations that go through the whole file, 0 for the others
+static double mb_per_s(const Result& r) {
+    bool whole = r.op == "load_file" || r.op == "save_file" || r.op == "find_all";
+    return whole && r.best > 0 ? r.bytes / r.best / 1e6 : 0;
+}
+
+static string json_string(const string& s) {
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+static void print_json() {
+    cout << "{\n  \"benchmark\": \"jot\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        double mbps = mb_per_s(r);
+        cout << "    {\"op\": " << json_string(r.op) << ", \"variant\": " << json_string(r.variant)
+             << ", \"bytes\": " << r.bytes << ", \"runs\": " << r.runs << ", \"best_ms\": " << r.best * 1e3
+             << ", \"mean_ms\": " << r.mean * 1e3 << ", \"mb_per_s\": " << mbps << ", \"count\": " << r.count
+             << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    cout << "  ]\n}\n";
+}
+
+static void print_csv() {
+    cout << "op,variant,bytes,runs,best_ms,mean_ms,mb_per_s,count\n";
+    for (const Result& r : results) {
+        double mbps = mb_per_s(r);
+        cout << r.op << "," << r.variant << "," << r.bytes << "," << r.runs << "," << r.best * 1e3 << ","
+             << r.mean * 1e3 << "," << mbps << "," << r.count << "\n";
+    }
+}
+
+static void bench_file(const string& path, size_t bytes, int runs, const filesystem::path& dir) {
+    measure("load_file", "", bytes, runs, [&]() {
+        TextBuffer buf;
+        load_file(path, buf);
+        return buf.line_count();
+    });
+
+    // Time to the first screen of a progressive load, which should not grow with the file
+    measure("load_file_async", "first_screen", bytes, runs, [&]() {
+        TextBuffer buf;
+        load_file_async(path, buf);
+        size_t lines = buf.line_count();
+        cancel_load();
+        return lines;
+    });
+
+    TextBuffer buf;
+    load_file(path, buf);
+
+    // Queries: dense, common, rare/absent literals and two regular expressions
+    struct Query { const char* name; const char* q; bool regex; };
+    static const Query queries[] = {
+        {"single-byte", "E", false},
+        {"common", "status=404", false},
+        {"absent", "not-present-anywhere", false},
+        {"regex-class", "status=40[0-9]", true},
+        {"regex-repeat", "user_id=\\d+", true},
+    };
+    for (const Query& q : queries) {
+        measure("find_all", q.name, bytes, runs, [&]() { return find_all(buf, q.q, q.regex).size(); });
+    }
+
+    // Render: scroll a line at a time (every row changes) and move the cursor within a page (the
+    // text stays put, so the diff finds almost nothing to write)
+    int frames = (int)min<size_t>(buf.line_count(), 2000);
+    measure("render", "scroll", bytes, runs, [&]() {
+        screen_invalidate();
+        for (int r = 0; r < frames; ++r) {
+            render(buf, r, 0, "bench.txt", false, true, true, 80);
+            screen_flush();
+        }
+        return (size_t)frames;
+    });
+    measure("render", "cursor", bytes, runs, [&]() {
+        for (int r = 0; r < frames; ++r) {
+            render(buf, r % 20, r % 40, "bench.txt", false, true, true, 80);
+            screen_flush();
+        }
+        return (size_t)frames;
+    });
+
+    // Editing: type a character at spread-out places, then undo and redo all of it
+    const int EDITS = 1000;
+    size_t lines = buf.line_count();
+    measure("edit", "insert_text", bytes, 1, [&]() {
+        for (int i = 0; i < EDITS; ++i) {
+            int line = (int)((size_t)i * 7919 % lines);
+            insert_text(buf, line, 0, "x", line, 0);
+        }
+        return (size_t)EDITS;
+    });
+    size_t steps = 0;
+    measure("edit", "do_undo", bytes, 1, [&]() {
+        int row = 0, col = 0;
+        steps = 0;
+        while (do_undo(buf, row, col)) steps++;
+        return steps;
+    });
+    measure("edit", "do_redo", bytes, 1, [&]() {
+        int row = 0, col = 0;
+        size_t n = 0;
+        while (do_redo(buf, row, col)) n++;
+        return n;
+    });
+
+    // Save the file unchanged and with the edits above
+    string out = (dir / "bench_save.txt").string();
+    measure("save_file", "edited", bytes, runs, [&]() { return (size_t)save_file(out, buf); });
+    {
+        int row = 0, col = 0;
+        while (do_undo(buf, row, col)) {}
+    }
+    measure("save_file", "clean", bytes, runs, [&]() { return (size_t)save_file(out, buf); });
+    remove(out.c_str());
+}
+
+int main(int argc, char** argv) {
+    size_t maxSize = 64u << 20;
+    int runs = 3;
+    bool csv = false;
+    filesystem::path dir = filesystem::temp_directory_path() / "jot_bench";
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--max" && i + 1 < argc) maxSize = parse_size(argv[++i]);
+        else if (a == "--runs" && i + 1 < argc) runs = max(1, atoi(argv[++i]));
+        else if (a == "--csv") csv = true;
+        else if (a == "--dir" && i + 1 < argc) dir = argv[++i];
+        else {
+            cerr << "Usage: bench_suite [--max SIZE] [--runs N] [--csv] [--dir DIR]\n";
+            return 1;
+        }
+    }
+    filesystem::create_directories(dir);
+    set_undo_budget((size_t)1 << 40); // keep the history in memory; spilling is not what is measured
+
+    static const size_t sizes[] = {1u << 10, 64u << 10, 1u << 20, 16u << 20, 64u << 20, 256u << 20, (size_t)1 << 30};
+    for (size_t bytes : sizes) {
+        if (bytes > maxSize) break;
+        string path = (dir / ("bench_" + to_string(bytes) + ".txt")).string();
+        if (!filesystem::exists(path) || filesystem::file_size(path) != bytes) {
+            ofstream f(path, ios::binary);
+            string text = synthetic(bytes);
+            f.write(text.data(), (streamsize)text.size());
+        }
+        bench_file(path, bytes, runs, dir);
+    }
+
+    if (csv) print_csv();
+    else print_json();
+    return g_nullCells > 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+// Synthetic log-like text shared by the benchmarks, so every bench measures the same corpus and
+// their numbers stay comparable. Deterministic: the same arguments always give the same text.
+
+#pragma once
+
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+// Words the log lines are made of, picked by a fixed-seed LCG
+static const char* const SYNTHETIC_WORDS[] = {"GET", "POST", "/api/v1/users", "status=200", "status=404",
+                                              "latency_ms=", "user_id=", "session", "ERROR", "WARN", "INFO",
+                                              "connection reset by peer", "request completed", "cache miss",
+                                              "retrying"};
+static const unsigned SYNTHETIC_WORD_COUNT = sizeof(SYNTHETIC_WORDS) / sizeof(SYNTHETIC_WORDS[0]);
+
+// The next pseudo-random word
+static inline const char* synthetic_word(unsigned& x) {
+    x = x * 1103515245u + 12345u;
+    return SYNTHETIC_WORDS[(x >> 16) % SYNTHETIC_WORD_COUNT];
+}
+
+// `bytes` bytes of log lines: 4-13 words separated by spaces or tabs, then a number
+static inline string synthetic(size_t bytes) {
+    string s;
+    s.reserve(bytes + 256);
+    unsigned x = 12345;
+    while (s.size() < bytes) {
+        int n = 4 + (x >> 8) % 10;
+        for (int w = 0; w < n; ++w) {
+            s += synthetic_word(x);
+            s += (x & 1) ? ' ' : '\t';
+        }
+        s += to_string(x % 100000);
+        s += '\n';
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// The same words with `q` planted `occurrences` times, after every 2-7 words, ending with "end".
+// Words containing `q` are left out, so it occurs exactly `occurrences` times.
+static inline string synthetic_with(size_t occurrences, const string& q) {
+    string s;
+    unsigned x = 12345;
+    for (size_t i = 0; i < occurrences; ++i) {
+        int n = 2 + (x >> 8) % 6;
+        for (int w = 0; w < n; ++w) {
+            const char* word = synthetic_word(x);
+            if (!q.empty() && strstr(word, q.c_str())) continue;
+            s += word;
+            s += ' ';
+        }
+        s += q;
+        s += (x & 3) ? ' ' : '\n';
+    }
+    s += "end";
+    return s;
+}
@@ -0,0 +1,53 @@
+// Headless terminal for benchmarks: the term.h API with a fixed-size window and no input, where
+// frames are counted instead of written. Linked in place of term.cpp.
+
+#include "../term.h"
+
+// Size of the pretend window; benchmarks may change it before the first frame
+int g_nullWidth = 120, g_nullHeight = 40;
+
+// Cells the last frames would have written, so a benchmark can tell the work is not skipped
+size_t g_nullCells = 0;
+
+void term_init() {}
+void term_restore() {}
+
+bool term_window(int& width, int& height) {
+    width = g_nullWidth;
+    height = g_nullHeight;
+    return false;
+}
+
+Attr term_default_attr() {
+    return FG_RED | FG_GREEN | FG_BLUE;
+}
+
+void term_present(const vector<Cell>& cells, int width, const vector<CellRun>& runs, int cx, int cy) {
+    (void)cells; (void)width; (void)cx; (void)cy;
+    for (const CellRun& r : runs) g_nullCells += (size_t)(r.last - r.first + 1);
+}
+
+void term_clear() {}
+
+int term_getch() { return 27; }
+
+const string& term_paste_text() {
+    static const string none;
+    return none;
+}
+
+bool term_kbhit() { return false; }
+
+bool term_wait_key(int ms) {
+    (void)ms;
+    return false;
+}
+
+bool term_key_down(TermKey key) {
+    (void)key;
+    return false;
+}
+
+void term_font_size(int delta) {
+    (void)delta;
+}
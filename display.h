@@ -2,7 +2,7 @@
 
 #include <string>
 #include <vector>
-#include <windows.h>
+#include "screen.h"
 #include "util.h"
 
 using namespace std;
@@ -12,17 +12,20 @@ extern volatile bool g_ignoreCtrlC;
 extern bool g_showTitle;
 extern bool g_showInfo;
 
-// Render the text buffer to the console.
-void render(const vector<string>& lines, int row, int col, const string& filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol, int reservePromptLines = 0);
+// Compose the text buffer into the screen's back buffer; screen_flush() shows it.
+void render(const TextBuffer& buf, int row, int col, const string& filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol, int reservePromptLines = 0);
 
-// Clear the console screen (Windows) and reset cursor to home.
+// Clear the console screen and reset cursor to home.
 void clear_console();
 
+// Buffer lines [first, last) shown in the viewport when the cursor is on `curRow`
+void visible_lines(int curRow, int headerOffset, int &first, int &last);
+
 // Overlay highlight for matches that are visible in the current viewport
-void highlight_matches_overlay(const vector<Match>& matches, const vector<string>& lines, int curRow, bool showLineNumbers, int headerOffset = 0, int selectedIndex = -1);
+void highlight_matches_overlay(const vector<Match>& matches, const TextBuffer& buf, int curRow, bool showLineNumbers, int headerOffset = 0, int selectedIndex = -1);
 
-// Draw prompt at header area and return the coordinate where user input should start
-COORD draw_prompt(const string &promptText);
+// Draw prompt at header area (in the back buffer) and return the coordinate where user input should start
+ScreenPos draw_prompt(const string &promptText);
 
 // Adjust the console font size by a delta (+1 to increase, -1 to decrease)
 void change_font_size(int delta);
@@ -2,16 +2,51 @@
 #include "fileio.h"
 #include "undo.h"
 #include "input.h"
+#include "replay.h"
 #include <algorithm>
-#include <conio.h>
-#include <windows.h>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
+/**
+ * Insert text at the cursor, which may span lines, and leave the cursor after it. This is one
+ * buffer edit and one undo step however long the text is.
+ *
+ * @param buf The text buffer being edited
+ * @param row The cursor row (moved to the last line of the text)
+ * @param col The cursor column (moved to just after the text)
+ * @param text The text to insert, lines separated by '\n'
+ */
+static void insert_block(TextBuffer& buf, int& row, int& col, const string& text) {
+    insert_text(buf, row, col, text, row, col);
+    size_t lastBreak = text.rfind('\n');
+    if (lastBreak == string::npos) {
+        col += (int)text.size();
+    } else {
+        row += (int)count(text.begin(), text.end(), '\n');
+        col = (int)(text.size() - lastBreak - 1);
+    }
+}
+
+/**
+ * Whether a key edits or saves the buffer (as opposed to moving around, finding or quitting)
+ *
+ * @param c The key read with term_getch
+ * @return True for paste, save, replace, cut, duplicate, undo/redo, Enter, Backspace and text
+ */
+static bool changes_buffer(int c) {
+    switch (c) {
+        case TERM_PASTE: case 19: case 18: case 24: case 22: case 4: case 26: case 25: case 13: case 8:
+            return true;
+    }
+    return c >= 32 && c <= 126;
+}
+
 /**
  * Run the main editor loop. Parameters are passed by reference so the caller can observe final cursor/clipboard state if desired.
  * 
- * @param lines The text buffer being edited
+ * @param buf The text buffer being edited
  * @param row The current cursor row (updated during editing)
  * @param col The current cursor column (updated during editing)
  * @param filename The name of the file being edited
@@ -21,65 +56,131 @@ using namespace std;
  * @param guideCol The column number of the guide
  * @param clipboard The clipboard string for copy/paste operations
  */
-void run_editor(vector<string>& lines, int& row, int& col, string& filename, bool& unixMode, bool& showLineNumbers, bool& showGuide, int& guideCol, string& clipboard) {
+void run_editor(TextBuffer& buf, int& row, int& col, string& filename, bool& unixMode, bool& showLineNumbers, bool& showGuide, int& guideCol, string& clipboard) {
+    // Save progress/result shown in the prompt area; cleared by the first key after a save completes
+    string status;
+    auto redraw = [&]() {
+        render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, status.empty() ? 0 : 1);
+        if (!status.empty()) draw_prompt(status);
+        screen_flush();
+    };
+
+    // Keys are handled as they arrive and the screen is redrawn once none are waiting, so a burst
+    // of input (key repeat, fast typing, a terminal paste) costs one frame instead of one per key
+    bool dirty = false;
+    auto nextFrame = chrono::steady_clock::now(); // earliest time for the next frame under -f
+    bool cutRun = false; // the last key was Ctrl+X, so another one adds to the clipboard
+
     // Initial render should have been called by main.
     while (true) {
-        int c = _getch();
+        if (dirty && !term_kbhit()) {
+            auto now = chrono::steady_clock::now();
+            int wait = g_maxFps > 0 && now < nextFrame ? (int)chrono::duration_cast<chrono::milliseconds>(nextFrame - now).count() + 1 : 0;
+            // Under a frame-rate cap, keys that arrive before the next frame is due go first
+            if (wait == 0 || !term_wait_key(wait)) {
+                redraw();
+                dirty = false;
+                if (g_maxFps > 0) nextFrame = chrono::steady_clock::now() + chrono::microseconds(1000000 / g_maxFps);
+            }
+        }
+        // While a background save or load runs, poll for keys so its progress shows as it happens.
+        // A replay's next key waits for that to finish, but not for a paused stdin, which may
+        // never end.
+        while (true) {
+            bool busy = save_in_progress() || (load_in_progress() && !(replay_active() && load_idle()));
+            string savedName; bool saved;
+            if (poll_save(savedName, saved)) {
+                status = string(saved ? "Saved to: " : "Save failed: ") + savedName;
+                redraw();
+            }
+            bool atEnd = row + 1 == (int)buf.line_count();
+            if (poll_load(buf)) { // more of the input is in; under -F a cursor on the last line stays there
+                if (g_follow && atEnd) { row = (int)buf.line_count() - 1; col = 0; }
+                redraw();
+            }
+            if (!busy || term_kbhit()) break;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        int c = term_getch();
+        // A finished save's message stays up until the next key
+        if (!save_in_progress()) status.clear();
+        bool cutBefore = cutRun;
+        cutRun = c == 24;
+
+        // Ctrl+E while stdin streams in: stop reading it, so the text received can be edited
+        if (c == 5 && load_streaming()) {
+            bool atEnd = row + 1 == (int)buf.line_count();
+            end_stream(buf);
+            if (g_follow && atEnd) { row = (int)buf.line_count() - 1; col = 0; }
+            status = "Stopped reading stdin: the text can be edited";
+            dirty = true;
+            continue;
+        }
+
+        // Until the whole file is in, the buffer can be viewed and searched but not changed. Text
+        // still arriving on stdin can be saved: the save writes what has arrived so far.
+        if (load_in_progress() && changes_buffer(c) && !(c == 19 && load_streaming())) {
+            status = load_streaming() ? "Reading stdin: read-only until it ends or Ctrl+E stops it"
+                                      : "Still loading: read-only until the whole file is in";
+            dirty = true;
+            continue;
+        }
+
+        if (c == TERM_PASTE) { // Pasted text goes in as one edit, not key by key
+            insert_block(buf, row, col, term_paste_text());
+            dirty = true;
+            continue;
+        }
 
         if (c == 0 || c == 224) {
-            int s = _getch();
+            int s = term_getch();
             // Arrow Keys
             if (s == 72) { // Up
                 if (row > 0) {
-                    row--; if (col > (int)lines[row].size()) col = (int)lines[row].size();
+                    row--; if (col > (int)buf.line_length(row)) col = (int)buf.line_length(row);
                 }
             } else if (s == 80) { // Down
-                if (row + 1 < (int)lines.size()) {
-                    row++; if (col > (int)lines[row].size()) col = (int)lines[row].size();
+                if (row + 1 < (int)buf.line_count()) {
+                    row++; if (col > (int)buf.line_length(row)) col = (int)buf.line_length(row);
                 }
             } else if (s == 75) { // Left
-                if (col > 0) col--; else if (row > 0) { row--; col = (int)lines[row].size(); }
+                if (col > 0) col--; else if (row > 0) { row--; col = (int)buf.line_length(row); }
             } else if (s == 77) { // Right
-                if (col < (int)lines[row].size()) col++; else if (row + 1 < (int)lines.size()) { row++; col = 0; }
+                if (col < (int)buf.line_length(row)) col++; else if (row + 1 < (int)buf.line_count()) { row++; col = 0; }
             }
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            dirty = true;
             continue;
         }
 
         // Control keys
         if (c == 19) { // Ctrl+S Save (Ctrl+Shift+S => Save As)
-            bool shiftDown = (GetAsyncKeyState(VK_SHIFT) & 0x8000) != 0;
+            bool shiftDown = term_key_down(KEY_SHIFT);
             // If Shift is down OR there is no current filename, prompt for Save As
             if (shiftDown || filename.empty()) {
-                render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 1);
+                render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 1);
                 // Emphasize user must provide a filename
-                COORD promptCoord = draw_prompt("Save As (Required): ");
+                ScreenPos promptCoord = draw_prompt("Save As (Required): ");
                 string newname;
                 if (input_line(newname, promptCoord)) {
                     if (!newname.empty()) {
-                        save_file(newname, lines);
                         filename = newname;
-                        // Flash confirmation
-                        render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 1);
-                        draw_prompt(string("Saved to: ") + filename);
-                        Sleep(1000);
+                        status = "Saving " + filename + "...";
+                        save_file_async(filename, buf, g_saveInPlace);
                     }
                 }
-                render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+                dirty = true;
             } else {
-                // Regular save: save to existing filename and flash confirmation
-                save_file(filename, lines);
-                render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 1);
-                draw_prompt(string("Saved to: ") + filename);
-                Sleep(1000);
-                render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+                // Regular save: written in the background; the result replaces the status when done
+                status = "Saving " + filename + "...";
+                save_file_async(filename, buf, g_saveInPlace);
+                dirty = true;
             }
             continue;
         }
 
         // Ctrl + Plus / Ctrl + Minus — adjust console font size
         {
-            bool ctrlDown = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0;
+            bool ctrlDown = term_key_down(KEY_CONTROL);
             bool plusKey = false;
             bool minusKey = false;
 
@@ -88,135 +189,124 @@ void run_editor(vector<string>& lines, int& row, int& col, string& filename, boo
             if (c == '-') minusKey = true;
 
             // Check numpad and OEM keys asynchronously as well
-            if ((GetAsyncKeyState(VK_ADD) & 0x8000) != 0) plusKey = true;
-            if ((GetAsyncKeyState(VK_OEM_PLUS) & 0x8000) != 0) plusKey = true;
-            if ((GetAsyncKeyState(VK_SUBTRACT) & 0x8000) != 0) minusKey = true;
-            if ((GetAsyncKeyState(VK_OEM_MINUS) & 0x8000) != 0) minusKey = true;
+            if (term_key_down(KEY_PLUS)) plusKey = true;
+            if (term_key_down(KEY_MINUS)) minusKey = true;
 
             if (ctrlDown && plusKey) {
                 change_font_size(+1);
-                render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+                dirty = true;
                 // drain possible duplicate key event
                 continue;
             }
             if (ctrlDown && minusKey) {
                 change_font_size(-1);
-                render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+                dirty = true;
                 continue;
             }
         }
 
         if (c == 6) { // Ctrl+F Find
-            find_mode(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol);
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            find_mode(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol);
+            dirty = true;
             continue;
         }
 
         if (c == 18) { // Ctrl+R Replace
-            replace_mode(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol);
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            string note = replace_mode(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol);
+            if (!note.empty() && !save_in_progress()) status = note;
+            dirty = true;
             continue;
         }
 
         // Copy (Mode Dependent): Default Ctrl+C, Unix mode uses Ctrl+K
         if (!unixMode && c == 3) { // Ctrl+C Copy current line
-            clipboard = lines[row];
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            clipboard = buf.line(row);
+            dirty = true;
             continue;
         }
         if (unixMode && c == 11) { // Ctrl+K Copy current line in Unix mode
-            clipboard = lines[row];
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            clipboard = buf.line(row);
+            dirty = true;
             continue;
         }
 
         // Cut / Delete current line: Ctrl+X
         if (c == 24) { // Ctrl+X
-            // Save state for undo
-            push_undo(lines, row, col);
-            // Store the deleted line in the clipboard (cut semantics)
-            if (row >= 0 && row < (int)lines.size()) {
-                clipboard = lines[row];
-                lines.erase(lines.begin() + row);
-            } else {
+            // Store the deleted line in the clipboard (cut semantics); lines cut one after
+            // another collect there, so they can be pasted back as a block
+            if (row >= 0 && row < (int)buf.line_count()) {
+                string line = buf.line(row);
+                clipboard = cutBefore ? clipboard + "\n" + line : line;
+                int len = (int)line.size();
+                // Take the line break with the line; the buffer always keeps at least one line
+                if (buf.line_count() == 1) erase_text(buf, row, 0, len, row, col);
+                else if (row + 1 < (int)buf.line_count()) erase_text(buf, row, 0, len + 1, row, col);
+                else erase_text(buf, row - 1, (int)buf.line_length(row - 1), len + 1, row, col);
+            } else if (!cutBefore) {
                 clipboard.clear();
             }
 
-            // Ensure there's always at least one line
-            if (lines.empty()) {
-                lines.push_back(string());
-                row = 0; col = 0;
-            } else {
-                if (row >= (int)lines.size()) row = (int)lines.size() - 1;
-                if (col > (int)lines[row].size()) col = (int)lines[row].size();
-            }
+            if (row >= (int)buf.line_count()) row = (int)buf.line_count() - 1;
+            if (col > (int)buf.line_length(row)) col = (int)buf.line_length(row);
 
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            dirty = true;
             continue;
         }
 
         if (c == 22) { // Ctrl+V Paste
-            push_undo(lines, row, col);
             // Paste clipboard at cursor position (Insert, do not overwrite)
-            if (row >= 0 && row < (int)lines.size()) {
-                lines[row].insert(col, clipboard);
-                col += (int)clipboard.size();
+            if (row < 0 || row >= (int)buf.line_count()) {
+                // If Somehow Empty, paste on a new last line
+                row = (int)buf.line_count() - 1;
+                col = (int)buf.line_length(row);
+                insert_block(buf, row, col, "\n" + clipboard);
             } else {
-                // If Somehow Empty, Create a New Line
-                lines.insert(lines.begin() + row + 1, clipboard);
-                row = min(row + 1, (int)lines.size() - 1);
-                col = (int)clipboard.size();
+                insert_block(buf, row, col, clipboard);
             }
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            dirty = true;
             continue;
         }
 
         if (c == 4) { // Ctrl+D Duplicate current line
-            push_undo(lines, row, col);
-            lines.insert(lines.begin() + row + 1, lines[row]);
-            row = row + 1; col = (int)lines[row].size();
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            insert_text(buf, row, (int)buf.line_length(row), "\n" + buf.line(row), row, col);
+            row = row + 1; col = (int)buf.line_length(row);
+            dirty = true;
             continue;
         }
         if (c == 26) { // Ctrl+Z Undo
-            if (do_undo(lines, row, col)) render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            if (do_undo(buf, row, col)) dirty = true;
+            continue;
+        }
+        if (c == 25) { // Ctrl+Y Redo
+            if (do_redo(buf, row, col)) dirty = true;
             continue;
         }
 
         if (c == 13) { // Enter
-            push_undo(lines, row, col);
-            string cur = lines[row];
-            string left = cur.substr(0, col);
-            string right = cur.substr(col);
-            lines[row] = left;
-            lines.insert(lines.begin() + row + 1, right);
+            insert_text(buf, row, col, "\n", row, col); // splits the line at the cursor
             row++; col = 0;
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            dirty = true;
             continue;
         }
 
         if (c == 8) { // Backspace
             if (col > 0) {
-                push_undo(lines, row, col);
-                lines[row].erase(col - 1, 1);
+                erase_text(buf, row, col - 1, 1, row, col);
                 col--;
             } else if (row > 0) {
-                push_undo(lines, row, col);
-                int prevLen = (int)lines[row-1].size();
-                lines[row-1] += lines[row];
-                lines.erase(lines.begin() + row);
+                int prevLen = (int)buf.line_length(row-1);
+                erase_text(buf, row-1, prevLen, 1, row, col); // join with the previous line
                 row--; col = prevLen;
             }
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            dirty = true;
             continue;
         }
 
         // Printable Characters
         if (c >= 32 && c <= 126) {
-            push_undo(lines, row, col);
-            lines[row].insert(lines[row].begin() + col, (char)c);
+            insert_text(buf, row, col, string(1, (char)c), row, col);
             col++;
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, false);
+            dirty = true;
             continue;
         }
 
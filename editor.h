@@ -6,5 +6,14 @@
 
 using namespace std;
 
+// Save small same-length edits by rewriting only the changed byte ranges (-d)
+extern bool g_saveInPlace;
+
+// Most frames drawn per second, 0 for no cap (-f)
+extern int g_maxFps;
+
+// Keep the cursor on the last line while input streams in, like tail -f (-F)
+extern bool g_follow;
+
 // Run the main editor loop. Parameters are passed by reference so the callercan observe final cursor/clipboard state if desired.
-void run_editor(vector<string>& lines, int& row, int& col, string& filename, bool& unixMode, bool& showLineNumbers, bool& showGuide, int& guideCol, string& clipboard);
+void run_editor(TextBuffer& buf, int& row, int& col, string& filename, bool& unixMode, bool& showLineNumbers, bool& showGuide, int& guideCol, string& clipboard);
@@ -1,37 +1,931 @@
 #include "fileio.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+// Files at least this large are memory-mapped instead of read into the heap
+static const unsigned long long MAP_THRESHOLD = 1ull << 20;
+
+// A read-only view of a whole file. Unmapped when the last TextBuffer copy lets go of it.
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    ~MappedFile() {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+#else
+    ~MappedFile() {
+        if (data) munmap((void*)data, size);
+    }
+#endif
+};
+
+/**
+ * Map `filename` read-only. Returns nullptr if the file is smaller than the mapping threshold
+ * or cannot be mapped, in which case the caller reads it normally.
+ *
+ * @param filename The name of the file to map
+ * @return The mapping, or nullptr
+ */
+static shared_ptr<MappedFile> map_file(const string& filename) {
+    auto m = make_shared<MappedFile>();
+#ifdef _WIN32
+    // Share delete so the file can still be renamed while it is mapped (see save_file)
+    m->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m->file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(m->file, &sz) || (unsigned long long)sz.QuadPart < MAP_THRESHOLD) return nullptr;
+    m->mapping = CreateFileMappingA(m->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m->mapping) return nullptr;
+    m->data = (const char*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->data) return nullptr;
+    m->size = (size_t)sz.QuadPart;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (unsigned long long)st.st_size < MAP_THRESHOLD) { close(fd); return nullptr; }
+    // Shared, so in-place saves (which write through the file) stay visible in the mapping
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return nullptr;
+    m->data = (const char*)p;
+    m->size = (size_t)st.st_size;
+#endif
+    return m;
+}
+
+// Size of the staging block used to batch small pieces into large writes
+static const size_t WRITE_BLOCK = 1 << 20;
+
+// What the file the buffer was mapped from looked like when it was last loaded or written.
+// In-place saves are only allowed while the file on disk still matches this.
+static struct {
+    string path;
+    const char* original = nullptr;
+    uintmax_t fileSize = 0;
+    filesystem::file_time_type mtime;
+} onDisk;
+
+// Minimal unbuffered output file for the save path
+struct OutFile {
+#ifdef _WIN32
+    HANDLE h = INVALID_HANDLE_VALUE;
+    bool ok() const { return h != INVALID_HANDLE_VALUE; }
+#else
+    int fd = -1;
+    bool ok() const { return fd >= 0; }
+#endif
+
+    bool open(const string& path, bool create) {
+#ifdef _WIN32
+        h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        fd = ::open(path.c_str(), create ? (O_WRONLY | O_CREAT | O_TRUNC) : O_WRONLY, 0644);
+#endif
+        return ok();
+    }
+
+    bool write(const char* p, size_t n) {
+        while (n > 0) {
+            size_t chunk = min(n, (size_t)1 << 30);
+#ifdef _WIN32
+            DWORD done = 0;
+            if (!WriteFile(h, p, (DWORD)chunk, &done, nullptr) || done == 0) return false;
+#else
+            ssize_t done = ::write(fd, p, chunk);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) return false;
+#endif
+            p += done; n -= (size_t)done;
+        }
+        return true;
+    }
+
+    bool seek(unsigned long long off) {
+#ifdef _WIN32
+        LARGE_INTEGER li; li.QuadPart = (LONGLONG)off;
+        return SetFilePointerEx(h, li, nullptr, FILE_BEGIN) != 0;
+#else
+        return lseek(fd, (off_t)off, SEEK_SET) == (off_t)off;
+#endif
+    }
+
+    bool sync() {
+#ifdef _WIN32
+        return FlushFileBuffers(h) != 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    bool close() {
+        if (!ok()) return false;
+#ifdef _WIN32
+        bool closed = CloseHandle(h) != 0;
+        h = INVALID_HANDLE_VALUE;
+#else
+        bool closed = ::close(fd) == 0;
+        fd = -1;
+#endif
+        return closed;
+    }
+
+    ~OutFile() { close(); }
+};
+
+// Batches small pieces into WRITE_BLOCK-sized writes; large pieces go straight through
+struct BlockWriter {
+    OutFile& out;
+    string block;
+    bool failed = false;
+
+    explicit BlockWriter(OutFile& f) : out(f) { block.reserve(WRITE_BLOCK); }
+
+    void put(const char* p, size_t n) {
+        if (failed) return;
+        if (block.size() + n > WRITE_BLOCK) flush();
+        if (n >= WRITE_BLOCK) { failed = !out.write(p, n); return; }
+        block.append(p, n);
+    }
+
+    bool flush() {
+        if (!failed && !block.empty()) failed = !out.write(block.data(), block.size());
+        block.clear();
+        return !failed;
+    }
+};
+
+// Write document bytes [off, off + len) to `w`, expanding '\n' to the buffer's line terminator
+static void write_range(BlockWriter& w, const TextBuffer& buf, size_t off, size_t len) {
+    const string& eol = buf.eol();
+    buf.for_each_span(off, len, [&](const char* p, size_t n) {
+        if (eol == "\n") { w.put(p, n); return; }
+        const char* end = p + n;
+        for (const char* q = p; q < end; ++q) {
+            if (*q == '\n') { w.put(p, q - p); w.put(eol.data(), eol.size()); p = q + 1; }
+        }
+        w.put(p, end - p);
+    });
+}
+
+#ifndef _WIN32
+// Make a completed rename durable by syncing the directory that holds `path`
+static void sync_parent_dir(const string& path) {
+    filesystem::path dir = filesystem::path(path).parent_path();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) { fsync(fd); ::close(fd); }
+}
+#endif
+
+/**
+ * Rewrite only the changed byte ranges of `filename` in place. Only possible when the buffer is
+ * still mapped from that very file, the file has not changed on disk since, the document length is
+ * unchanged, and a small part of it was edited. Not crash-atomic, hence opt-in.
+ *
+ * @return True if the save was done in place; false means the caller should do a full save
+ */
+static bool save_in_place(const string& filename, const TextBuffer& buf) {
+    if (!buf.mapped() || onDisk.original != buf.original_data() || onDisk.path != filename) return false;
+    if (buf.eol() != "\n") return false;
+    error_code ec;
+    uintmax_t size = filesystem::file_size(filename, ec);
+    if (ec || size != onDisk.fileSize || size != buf.size() + (buf.final_newline() ? 1 : 0)) return false;
+    if (filesystem::last_write_time(filename, ec) != onDisk.mtime || ec) return false;
+
+    vector<pair<size_t, size_t>> ranges;
+    if (!buf.changed_ranges(ranges)) return false;
+    size_t dirty = 0;
+    for (const auto& r : ranges) dirty += r.second - r.first;
+    if (dirty > buf.size() / 8) return false; // a full rewrite costs about the same
+
+    OutFile f;
+    if (!f.open(filename, false)) return false;
+    BlockWriter w(f);
+    for (const auto& r : ranges) {
+        if (!w.flush() || !f.seek(r.first)) return false;
+        write_range(w, buf, r.first, r.second - r.first);
+    }
+    if (!w.flush() || !f.sync() || !f.close()) return false;
+    onDisk.mtime = filesystem::last_write_time(filename, ec);
+    return true;
+}
+
+/**
+ * Write the whole document to `f`, with the buffer's line terminator between lines, and flush it
+ * to disk.
+ *
+ * @param f The file to write to, open and empty
+ * @param buf The text buffer to write
+ * @return True if everything was written and synced
+ */
+static bool write_document(OutFile& f, const TextBuffer& buf) {
+    BlockWriter w(f);
+    write_range(w, buf, 0, buf.size());
+    if (buf.final_newline()) w.put(buf.eol().data(), buf.eol().size());
+    return w.flush() && f.sync();
+}
+
 /**
- * Save the provided lines to `filename`. If the file cannot be written, returns false.
+ * Save the buffer to `filename`, writing the buffer's line terminator between lines.
+ * The text is written in large blocks to a temporary file beside the target, flushed to disk,
+ * and then renamed over the target, so a crash mid-save never leaves a truncated file behind.
+ * A symlink is followed so the file it points to is replaced, not the link, and the new file gets
+ * the old one's mode and (where allowed) owner and group. A file with other hard links is
+ * written through instead, as a rename would split it from them; that is not crash-safe, and is
+ * not done while the buffer is still mapped from that very file.
+ * A mapped buffer may still be reading from the old file; on POSIX the old inode lives on for the
+ * mapping, and on Windows (which will not replace a mapped file) the old file is renamed aside
+ * and deleted, which takes effect once the mapping is closed.
  * 
  * @param filename The name of the file to save to
- * @param lines The text buffer to save
+ * @param buf The text buffer to save
+ * @param inPlace Rewrite only the changed byte ranges when that is possible (see save_in_place)
+ * @return True if the file was written, false if the file cannot be written
  */
-void save_file(const string& filename, const vector<string>& lines) {
-    ofstream ofs(filename);
-    if (!ofs) return;
-    for (size_t i = 0; i < lines.size(); ++i) {
-        ofs << lines[i];
-        if (i + 1 < lines.size()) ofs << '\n';
+bool save_file(const string& filename, const TextBuffer& buf, bool inPlace) {
+    if (inPlace && save_in_place(filename, buf)) return true;
+
+    error_code ec;
+    string target = filename;
+    bool exists = filesystem::exists(filename, ec);
+    if (exists) {
+        filesystem::path real = filesystem::canonical(filename, ec);
+        if (!ec) target = real.string();
+    }
+
+    // Other names share this file: write through it so they see the new text
+    bool mappedFromTarget = buf.mapped() && !onDisk.path.empty() && filesystem::equivalent(onDisk.path, target, ec);
+    if (exists && !mappedFromTarget && filesystem::hard_link_count(target, ec) > 1 && !ec) {
+        OutFile f;
+        if (!f.open(target, true)) return false;
+        bool ok = write_document(f, buf);
+        return f.close() && ok;
+    }
+
+    string tmp = target + ".jot-tmp";
+    OutFile f;
+    if (!f.open(tmp, true)) return false;
+    bool ok = write_document(f, buf);
+#ifndef _WIN32
+    // Keep the target's mode, owner and group (the owner only changes if we are allowed to)
+    struct stat st;
+    if (ok && exists && stat(target.c_str(), &st) == 0) {
+        ok = fchmod(f.fd, st.st_mode & 07777) == 0;
+        // Failing both only leaves the file owned by whoever saved it, so the save goes on
+        bool owned = fchown(f.fd, st.st_uid, st.st_gid) == 0 || fchown(f.fd, (uid_t)-1, st.st_gid) == 0;
+        (void)owned;
+    }
+#endif
+    ok = f.close() && ok;
+    if (!ok) { remove(tmp.c_str()); return false; }
+
+#ifdef _WIN32
+    // Keep the target's permissions
+    filesystem::file_status st = filesystem::status(target, ec);
+    if (!ec && filesystem::exists(st)) filesystem::permissions(tmp, st.permissions(), ec);
+
+    string bak = target + ".jotbak";
+    DeleteFileA(bak.c_str()); // left by an earlier save whose mapping has since been closed
+    if (!MoveFileExA(tmp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        // A mapped file cannot be replaced, but it can be renamed aside and then deleted: it was
+        // mapped with FILE_SHARE_DELETE, so it goes away once the mapping is closed
+        if (!MoveFileExA(target.c_str(), bak.c_str(), MOVEFILE_REPLACE_EXISTING) ||
+            !MoveFileExA(tmp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            remove(tmp.c_str());
+            return false;
+        }
+        DeleteFileA(bak.c_str());
+    }
+#else
+    if (rename(tmp.c_str(), target.c_str()) != 0) { remove(tmp.c_str()); return false; }
+    sync_parent_dir(target);
+#endif
+    // The file no longer matches the original buffer
+    if (onDisk.path == filename) onDisk.original = nullptr;
+    return true;
+}
+
+// ---- Background saves ----
+
+struct SaveJob {
+    string filename;
+    TextBuffer snapshot;
+    bool inPlace;
+};
+
+static mutex saveMutex;
+static thread saveThread;
+static bool saveRunning = false;
+static unique_ptr<SaveJob> pendingSave;             // the newest request made while busy
+static vector<pair<string, bool>> finishedSaves;    // results not yet reported
+
+static void save_worker(unique_ptr<SaveJob> job) {
+    while (job) {
+        bool ok = save_file(job->filename, job->snapshot, job->inPlace);
+        lock_guard<mutex> lock(saveMutex);
+        finishedSaves.push_back({job->filename, ok});
+        job = std::move(pendingSave);
+        if (!job) saveRunning = false;
+    }
+}
+
+/**
+ * Save `buf` to `filename` on a background thread and return immediately.
+ *
+ * @param filename The name of the file to save to
+ * @param buf The text buffer to save (snapshotted before returning)
+ * @param inPlace Passed on to save_file
+ */
+void save_file_async(const string& filename, const TextBuffer& buf, bool inPlace) {
+    unique_ptr<SaveJob> job(new SaveJob{filename, buf, inPlace});
+    lock_guard<mutex> lock(saveMutex);
+    if (saveRunning) {
+        pendingSave = std::move(job); // supersedes any older queued snapshot
+        return;
+    }
+    if (saveThread.joinable()) saveThread.join(); // already finished
+    saveRunning = true;
+    saveThread = thread(save_worker, std::move(job));
+}
+
+bool save_in_progress() {
+    lock_guard<mutex> lock(saveMutex);
+    return saveRunning;
+}
+
+bool poll_save(string& filename, bool& ok) {
+    lock_guard<mutex> lock(saveMutex);
+    if (finishedSaves.empty()) return false;
+    filename = finishedSaves.front().first;
+    ok = finishedSaves.front().second;
+    finishedSaves.erase(finishedSaves.begin());
+    return true;
+}
+
+void wait_for_saves() {
+    while (save_in_progress()) this_thread::sleep_for(chrono::milliseconds(5));
+    lock_guard<mutex> lock(saveMutex);
+    if (saveThread.joinable()) saveThread.join();
+}
+
+// Fill in `stats` (if any) for a load that started at `t0`
+static void finish_stats(LoadStats* stats, chrono::steady_clock::time_point t0, size_t bytes, const TextBuffer& buf, bool mapped) {
+    if (!stats) return;
+    stats->bytes = bytes;
+    stats->lines = buf.line_count();
+    stats->seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    stats->mapped = mapped;
+}
+
+/**
+ *  Load `filename` into `buf`. Returns true if the file was successfully opened and read.
+ *  Large files are memory-mapped and only indexed: their text is never copied, and only lines that
+ *  are edited end up in heap memory. The newline index is built with SIMD scanning, split across
+ *  threads for large files. CRLF files are normalized to '\n' in memory (this needs a copy, so they
+ *  are always read) and remember CRLF for saving; a single trailing newline is dropped so the line
+ *  count matches what getline would have produced.
+ * 
+ * @param filename The name of the file to load
+ * @param buf The text buffer to load into
+ * @param stats If not null, receives the size and timing of the load
+ * @return True if the file was loaded
+ */
+bool load_file(const string& filename, TextBuffer& buf, LoadStats* stats) {
+    auto t0 = chrono::steady_clock::now();
+    if (shared_ptr<MappedFile> m = map_file(filename)) {
+        const char* firstLf = (const char*)memchr(m->data, '\n', m->size);
+        bool crlf = firstLf && firstLf > m->data && firstLf[-1] == '\r';
+        if (!crlf) {
+#ifndef _WIN32
+            madvise((void*)m->data, m->size, MADV_SEQUENTIAL); // the newline index scans it once
+#endif
+            size_t docSize = m->size - (m->data[m->size - 1] == '\n' ? 1 : 0);
+            buf.assign_external(m->data, docSize, m);
+#ifndef _WIN32
+            madvise((void*)m->data, m->size, MADV_RANDOM);
+#endif
+            buf.set_eol("\n");
+            buf.set_final_newline(docSize < m->size);
+            error_code ec;
+            onDisk.path = filename;
+            onDisk.original = buf.original_data();
+            onDisk.fileSize = m->size;
+            onDisk.mtime = filesystem::last_write_time(filename, ec);
+            finish_stats(stats, t0, m->size, buf, true);
+            return true;
+        }
     }
+
+    ifstream ifs(filename, ios::binary);
+    if (!ifs) return false;
+    string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    size_t bytes = data.size();
+    bool crlf = false;
+    size_t firstLf = data.find('\n');
+    if (firstLf != string::npos && firstLf > 0 && data[firstLf - 1] == '\r') {
+        crlf = true;
+        size_t w = 0;
+        for (size_t r = 0; r < data.size(); ++r) {
+            if (data[r] == '\r' && r + 1 < data.size() && data[r + 1] == '\n') continue;
+            data[w++] = data[r];
+        }
+        data.resize(w);
+    }
+    bool finalNewline = !data.empty() && data.back() == '\n';
+    if (finalNewline) data.pop_back();
+    buf.assign(std::move(data));
+    buf.set_eol(crlf ? "\r\n" : "\n");
+    buf.set_final_newline(finalNewline);
+    finish_stats(stats, t0, bytes, buf, false);
+    return true;
 }
 
 /**
- *  Load `filename` into `lines`. Returns true if the file was successfully opened and read.
+ *  Load `filename` line by line through ifstream/getline, the way Jot originally did. Only used to
+ *  measure the mapped/SIMD loader against.
  * 
  * @param filename The name of the file to load
- * @param lines The text buffer to load into
+ * @param buf The text buffer to load into
+ * @param stats If not null, receives the size and timing of the load
+ * @return True if the file was loaded
  */
-bool load_file(const string& filename, vector<string>& lines) {
+bool load_file_getline(const string& filename, TextBuffer& buf, LoadStats* stats) {
+    auto t0 = chrono::steady_clock::now();
     ifstream ifs(filename);
     if (!ifs) return false;
     vector<string> tmp;
     string l;
-    while (getline(ifs, l)) tmp.push_back(l);
-    if (tmp.empty()) tmp.push_back("");
-    lines = std::move(tmp);
+    size_t bytes = 0;
+    while (getline(ifs, l)) { bytes += l.size() + 1; tmp.push_back(l); }
+    string text;
+    text.reserve(bytes);
+    for (size_t i = 0; i < tmp.size(); ++i) {
+        if (i) text += '\n';
+        text += tmp[i];
+    }
+    buf.assign(std::move(text));
+    finish_stats(stats, t0, bytes, buf, false);
     return true;
 }
+
+// ---- Background loads ----
+
+// Size of the first part a background load hands over; later parts double up to LOAD_CHUNK_MAX,
+// so the first screen is ready after the same small amount of work whatever the file size
+static const size_t LOAD_CHUNK_MIN = 256 << 10;
+static const size_t LOAD_CHUNK_MAX = 64 << 20;
+
+// Largest read from a stream, and the address space reserved for the text read from one
+static const size_t STREAM_BLOCK = 1 << 20;
+static const unsigned long long STREAM_RESERVE = 1ull << 40;
+
+// A part of the document made ready by the loader thread
+struct LoadChunk {
+    size_t end;            // document bytes [0, end) are final
+    size_t read;           // input bytes consumed so far
+    NewlineIndex newlines; // the newlines of this part
+    bool lineEnds;         // a line terminator has arrived after `end` (stdin)
+};
+
+static mutex loadMutex;
+static thread loadThread;
+static atomic<bool> loadCancel{false};
+static atomic<bool> loadIdle{false};   // stdin has paused and everything read is handed over
+static vector<LoadChunk> loadedChunks; // produced by the loader, not handed over yet
+static bool loadFinished = false;      // the loader has produced its last chunk
+static string loadEol;                 // line terminator found in the input ("" if none)
+static bool loadFinalNewline = false;  // the input ended with a line terminator
+static bool loading = false;           // the buffer does not hold the whole input yet (main thread)
+static size_t loadRead = 0, loadTotal = 0; // input bytes handed over, and all of them (0 if unknown)
+
+// Memory for text read from a stream. Address space is reserved up front and pages are committed
+// as the text grows, so the text never moves and memory use follows what has been read.
+struct StreamStore {
+    char* data = nullptr;
+    size_t reserved = 0;
+#ifdef _WIN32
+    size_t committed = 0;
+    ~StreamStore() {
+        if (data) VirtualFree(data, 0, MEM_RELEASE);
+    }
+#else
+    ~StreamStore() {
+        if (data) munmap(data, reserved);
+    }
+#endif
+
+    // Reserve as much of STREAM_RESERVE as the system allows
+    bool reserve() {
+        for (unsigned long long size = sizeof(void*) < 8 ? 1ull << 30 : STREAM_RESERVE; size >= STREAM_BLOCK; size /= 2) {
+#ifdef _WIN32
+            data = (char*)VirtualAlloc(nullptr, (SIZE_T)size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+            // Pages only take memory once written; NORESERVE keeps the reservation out of overcommit accounting
+            void* p = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            data = p == MAP_FAILED ? nullptr : (char*)p;
+#endif
+            if (data) { reserved = (size_t)size; return true; }
+        }
+        return false;
+    }
+
+    // Make data[0, bytes) writable
+    bool commit(size_t bytes) {
+#ifdef _WIN32
+        if (bytes <= committed) return true;
+        size_t grow = min(reserved - committed, max(bytes - committed, STREAM_BLOCK * 16));
+        if (!VirtualAlloc(data + committed, grow, MEM_COMMIT, PAGE_READWRITE)) return false;
+        committed += grow;
+        return true;
+#else
+        return bytes <= reserved;
+#endif
+    }
+};
+
+/**
+ * Hand a part of the document over to the main thread.
+ *
+ * @param doc The document bytes
+ * @param from Where the part starts (the end of the previous part)
+ * @param end Where it ends
+ * @param read Input bytes consumed so far
+ * @param lineEnds Whether a line terminator has been read after `end`
+ */
+static void publish(const char* doc, size_t from, size_t end, size_t read, bool lineEnds = false) {
+    LoadChunk c{end, read, NewlineIndex(), lineEnds};
+    index_newlines(doc + from, end - from, from, c.newlines);
+    lock_guard<mutex> lock(loadMutex);
+    loadedChunks.push_back(std::move(c));
+}
+
+/**
+ * Note the end of the input for poll_load.
+ *
+ * @param eol The line terminator the input uses ("" if it has no line breaks)
+ * @param finalNewline Whether a line terminator ended the input
+ */
+static void finish_load(const string& eol, bool finalNewline) {
+    lock_guard<mutex> lock(loadMutex);
+    loadEol = eol;
+    loadFinalNewline = finalNewline;
+    loadFinished = true;
+}
+
+/**
+ * Index the mapped file part by part and hand each part over through loadedChunks. CRLF files are
+ * normalized into `out` on the way; otherwise the mapping itself is the document.
+ *
+ * @param m The mapped file
+ * @param out Receives the text with CRLF turned into '\n', or nullptr to use the mapping as it is
+ */
+static void load_worker(shared_ptr<MappedFile> m, char* out) {
+    const char* in = m->data;
+    size_t n = m->size;
+#ifndef _WIN32
+    madvise((void*)in, n, MADV_SEQUENTIAL);
+#endif
+    size_t r = 0, w = 0; // bytes read from the file and written to the document
+    size_t chunk = LOAD_CHUNK_MIN;
+    while (r < n && !loadCancel) {
+        size_t to = min(n, r + chunk), from = w;
+        if (out) {
+            if (to < n && in[to - 1] == '\r') --to; // keep a CR with the LF that may follow it
+            for (; r < to; ++r) {
+                if (in[r] == '\r' && r + 1 < n && in[r + 1] == '\n') continue;
+                out[w++] = in[r];
+            }
+        } else {
+            r = w = to;
+        }
+        const char* doc = out ? out : in;
+        size_t end = w;
+        if (r == n && doc[end - 1] == '\n') --end; // a final newline is not part of the document
+        publish(doc, from, end, r);
+        chunk = min(chunk * 2, LOAD_CHUNK_MAX);
+    }
+#ifndef _WIN32
+    if (!out) madvise((void*)in, n, MADV_RANDOM);
+#endif
+    finish_load(out ? "\r\n" : "\n", in[n - 1] == '\n');
+}
+
+/**
+ * Start handing over a load and wait for its first part.
+ *
+ * @param buf The text buffer being loaded into
+ * @param total Size of the input, or 0 if it is not known
+ * @param worker What the loader thread runs; started once the previous load's state is cleared
+ * @param firstWait How many milliseconds to wait for the first part, -1 for as long as it takes
+ */
+static void start_load(TextBuffer& buf, size_t total, function<void()> worker, int firstWait) {
+    loadCancel = false;
+    loadFinished = false;
+    loadedChunks.clear();
+    loadEol.clear();
+    loading = true;
+    loadRead = 0;
+    loadTotal = total;
+    loadThread = thread(std::move(worker));
+    for (int waited = 0; !poll_load(buf) && (firstWait < 0 || waited < firstWait); ++waited) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+/**
+ * Load `filename` into `buf`, reading and indexing a large file on a background thread. `buf`
+ * holds the first part of the file when this returns and grows each time poll_load is called;
+ * files below the mapping threshold (or that cannot be mapped) are loaded at once by load_file.
+ *
+ * @param filename The name of the file to load
+ * @param buf The text buffer to load into
+ * @return True if the file was opened
+ */
+bool load_file_async(const string& filename, TextBuffer& buf) {
+    cancel_load();
+    shared_ptr<MappedFile> m = map_file(filename);
+    if (!m) return load_file(filename, buf);
+    const char* firstLf = (const char*)memchr(m->data, '\n', min(m->size, LOAD_CHUNK_MIN));
+    bool crlf = firstLf && firstLf > m->data && firstLf[-1] == '\r';
+    char* out = nullptr;
+    if (crlf) {
+        // Normalized text is never longer than the file; the buffer owns it from the start
+        shared_ptr<char> copy(new char[m->size], default_delete<char[]>());
+        out = copy.get();
+        buf.assign_external(out, 0, copy);
+    } else {
+        buf.assign_external(m->data, 0, m);
+        error_code ec;
+        onDisk.path = filename;
+        onDisk.original = buf.original_data();
+        onDisk.fileSize = m->size;
+        onDisk.mtime = filesystem::last_write_time(filename, ec);
+    }
+    // The first part is small: wait for it so the first frame has text
+    start_load(buf, m->size, [m, out] { load_worker(m, out); }, -1);
+    return true;
+}
+
+/**
+ * Whether stdin has input (or has ended) within `ms` milliseconds
+ *
+ * @param ms How long to wait
+ * @return True if a read will not block
+ */
+static bool stdin_ready(int ms) {
+#ifdef _WIN32
+    HANDLE h = GetStdHandle(STD_INPUT_HANDLE);
+    if (GetFileType(h) != FILE_TYPE_PIPE) return true; // a redirected file never blocks for long
+    for (int waited = 0;; waited += 10) {
+        DWORD avail = 0;
+        if (!PeekNamedPipe(h, nullptr, 0, nullptr, &avail, nullptr) || avail > 0) return true; // data, or closed
+        if (waited >= ms) return false;
+        Sleep(10);
+    }
+#else
+    struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+    return poll(&p, 1, ms) != 0;
+#endif
+}
+
+/**
+ * Read up to `n` bytes of stdin
+ *
+ * @param dst Where the bytes go
+ * @param n How many to read at most
+ * @return The number of bytes read, 0 at the end of the input or on an error
+ */
+static size_t read_stdin(char* dst, size_t n) {
+#ifdef _WIN32
+    DWORD got = 0;
+    if (!ReadFile(GetStdHandle(STD_INPUT_HANDLE), dst, (DWORD)n, &got, nullptr)) return 0;
+    return got;
+#else
+    while (true) {
+        ssize_t got = read(STDIN_FILENO, dst, n);
+        if (got < 0 && errno == EINTR) continue;
+        return got > 0 ? (size_t)got : 0;
+    }
+#endif
+}
+
+/**
+ * Drop the CR of every CRLF in p[0, n), in place. A CR at the very end is kept.
+ *
+ * @param p The text
+ * @param n Its length
+ * @return The new length
+ */
+static size_t drop_crlf_cr(char* p, size_t n) {
+    size_t w = 0;
+    for (size_t r = 0; r < n; ++r) {
+        if (p[r] == '\r' && r + 1 < n && p[r + 1] == '\n') continue;
+        p[w++] = p[r];
+    }
+    return w;
+}
+
+/**
+ * Read stdin straight into the store in blocks of up to STREAM_BLOCK and hand the text over in
+ * parts: when a part has reached the current chunk size, or when the input pauses. A line
+ * terminator at the end of what has arrived is held back, so the document never ends with an
+ * empty line that more input would fill; the last one is dropped at the end like a file's.
+ *
+ * @param store Where the text goes; the document refers to it directly
+ */
+static void stream_worker(shared_ptr<StreamStore> store) {
+    char* doc = store->data;
+    size_t w = 0;       // text written to the store
+    size_t held = 0;    // 1 if a CR after it waits for the next read to see if an LF follows
+    size_t from = 0;    // start of the text not handed over yet
+    size_t read = 0;    // bytes read from stdin
+    size_t chunk = LOAD_CHUNK_MIN;
+    string eol;
+    bool more = true;
+    while (more && !loadCancel) {
+        // Hand over what is there when the input pauses
+        size_t ready = w - (w > from && doc[w - 1] == '\n' ? 1 : 0);
+        if (!stdin_ready(ready > from ? 0 : 100)) {
+            if (ready > from) { publish(doc, from, ready, read, ready < w); from = ready; }
+            else loadIdle = true;
+            continue;
+        }
+        loadIdle = false;
+        size_t room = store->reserved - w - held;
+        size_t got = room > 0 && store->commit(w + held + min(room, STREAM_BLOCK)) ? read_stdin(doc + w + held, min(room, STREAM_BLOCK)) : 0;
+        if (got == 0) { // end of the input (or of the store)
+            w += held;
+            more = false;
+        } else {
+            read += got;
+            char* p = doc + w;
+            size_t n = held + got;
+            if (eol.empty()) { // the first line break tells how lines end
+                const char* lf = (const char*)memchr(p, '\n', n);
+                if (lf) {
+                    eol = lf > doc && lf[-1] == '\r' ? "\r\n" : "\n";
+                    lock_guard<mutex> lock(loadMutex);
+                    loadEol = eol; // a save before the end writes the same line endings
+                }
+            }
+            if (eol == "\r\n") n = drop_crlf_cr(p, n);
+            held = n > 0 && p[n - 1] == '\r' ? 1 : 0;
+            w += n - held;
+        }
+        size_t end = w - (w > from && doc[w - 1] == '\n' ? 1 : 0);
+        if (end > from && (end - from >= chunk || !more)) {
+            publish(doc, from, end, read, end < w);
+            from = end;
+            chunk = min(chunk * 2, LOAD_CHUNK_MAX);
+        }
+    }
+    // Stopped early (end_stream): what was read still goes in
+    size_t end = w - (w > from && doc[w - 1] == '\n' ? 1 : 0);
+    if (end > from) { publish(doc, from, end, read, end < w); from = end; }
+    finish_load(eol, w > from);
+}
+
+/**
+ * Load stdin into `buf` as it arrives, for as long as it stays open (jot -). The text is read in
+ * large blocks straight into one store the buffer refers to, so it is held once. Returns after
+ * the first part has arrived or a short wait, whichever is first; poll_load adds the rest.
+ *
+ * @param buf The text buffer to load into
+ * @return False if stdin is a terminal or no memory could be reserved
+ */
+bool load_stdin_async(TextBuffer& buf) {
+    cancel_load();
+#ifdef _WIN32
+    if (GetFileType(GetStdHandle(STD_INPUT_HANDLE)) == FILE_TYPE_CHAR) return false;
+#else
+    if (isatty(STDIN_FILENO)) return false;
+#endif
+    auto store = make_shared<StreamStore>();
+    if (!store->reserve()) return false;
+    buf.assign_external(store->data, 0, store);
+    loadIdle = false;
+    start_load(buf, 0, [store] { stream_worker(store); }, 100);
+    return true;
+}
+
+/**
+ * Stop reading stdin (jot -) and close it, so a writer still producing text sees the pipe end.
+ * What was read so far is added to `buf`, which is then complete and can be edited.
+ *
+ * @param buf The text buffer given to load_stdin_async
+ */
+void end_stream(TextBuffer& buf) {
+    if (!load_streaming()) return;
+    loadCancel = true;
+    wait_for_load(buf);
+#ifdef _WIN32
+    CloseHandle(GetStdHandle(STD_INPUT_HANDLE));
+#else
+    close(STDIN_FILENO);
+#endif
+}
+
+/**
+ * Add the parts of the input the loader has produced since the last call to the end of `buf`.
+ * Call on the thread that owns `buf`, with no copy of it in use elsewhere.
+ *
+ * @param buf The text buffer given to load_file_async or load_stdin_async
+ * @return True if the buffer grew or the load finished
+ */
+bool poll_load(TextBuffer& buf) {
+    // A save's snapshot shares the buffer's storage, which must not grow under it
+    if (!loading || save_in_progress()) return false;
+    vector<LoadChunk> chunks;
+    bool finished;
+    string eol;
+    {
+        lock_guard<mutex> lock(loadMutex);
+        chunks.swap(loadedChunks);
+        finished = loadFinished;
+        eol = loadEol;
+    }
+    for (const LoadChunk& c : chunks) {
+        buf.extend_original(c.end, c.newlines);
+        buf.set_final_newline(c.lineEnds); // what a save before the end writes
+        loadRead = c.read;
+    }
+    if (!eol.empty()) buf.set_eol(eol);
+    if (finished) {
+        loadThread.join();
+        loading = false;
+        buf.set_final_newline(loadFinalNewline);
+    }
+    return !chunks.empty() || finished;
+}
+
+/**
+ * Hand over the rest of a background load, waiting until the input ends.
+ *
+ * @param buf The text buffer being loaded into
+ * @param untilIdle Return as soon as stdin pauses with everything read handed over (jot -)
+ */
+void wait_for_load(TextBuffer& buf, bool untilIdle) {
+    while (loading && !(untilIdle && load_idle())) {
+        if (!poll_load(buf)) this_thread::sleep_for(chrono::milliseconds(5));
+    }
+}
+
+bool load_in_progress() {
+    return loading;
+}
+
+bool load_streaming() {
+    return loading && loadTotal == 0;
+}
+
+bool load_idle() {
+    if (!load_streaming() || !loadIdle) return false;
+    lock_guard<mutex> lock(loadMutex);
+    return loadedChunks.empty();
+}
+
+bool load_ready() {
+    if (!loading || save_in_progress()) return false;
+    lock_guard<mutex> lock(loadMutex);
+    return !loadedChunks.empty() || loadFinished;
+}
+
+double load_fraction() {
+    return loadTotal > 0 ? (double)loadRead / loadTotal : -1;
+}
+
+void cancel_load() {
+    if (!loadThread.joinable()) return;
+    loadCancel = true;
+    loadThread.join();
+    loading = false;
+}
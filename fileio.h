@@ -2,10 +2,74 @@
 
 #include <string>
 #include <vector>
+#include "textbuffer.h"
 
 using std::string;
 using std::vector;
 using namespace std;
 
-void save_file(const string& filename, const vector<string>& lines);
-bool load_file(const string& filename, vector<string>& lines);
\ No newline at end of file
+// Size and timing of a load, for comparing loaders
+struct LoadStats {
+    size_t bytes = 0;
+    size_t lines = 0;
+    double seconds = 0;
+    bool mapped = false;
+    double gbps() const { return seconds > 0 ? bytes / seconds / 1e9 : 0; }
+};
+
+// Save atomically (temporary file + rename). With `inPlace`, small same-length edits to a mapped
+// file rewrite just the changed byte ranges instead.
+bool save_file(const string& filename, const TextBuffer& buf, bool inPlace = false);
+
+// Save on a background thread. The buffer is snapshotted first: only its piece list is copied,
+// the text itself is shared (it is never modified in place). A save requested while another is
+// running is written right after it.
+void save_file_async(const string& filename, const TextBuffer& buf, bool inPlace = false);
+
+// True while a background save is queued or being written
+bool save_in_progress();
+
+// Report one finished background save. Returns false if there is nothing to report.
+bool poll_save(string& filename, bool& ok);
+
+// Block until every background save has been written
+void wait_for_saves();
+bool load_file(const string& filename, TextBuffer& buf, LoadStats* stats = nullptr);
+
+// Load progressively: a large file is read and indexed on a background thread, `buf` holds its
+// first part on return and poll_load adds the rest as it arrives. Small files load at once.
+bool load_file_async(const string& filename, TextBuffer& buf);
+
+// Load stdin progressively (jot -), for as long as it stays open. Returns false if stdin is a
+// terminal.
+bool load_stdin_async(TextBuffer& buf);
+
+// Add what the background load has read since the last call to `buf`. Returns true if `buf` grew
+// or the load finished (so the screen should be redrawn). Holds back while a save is running.
+bool poll_load(TextBuffer& buf);
+
+// True if poll_load has something to hand over, so a caller can first stop threads reading the buffer
+bool load_ready();
+
+// Block until the whole input has been handed over to `buf`, or with `untilIdle` until stdin
+// pauses with all of what it sent handed over
+void wait_for_load(TextBuffer& buf, bool untilIdle = false);
+
+// True until poll_load has handed over the whole input, and the fraction of it read so far (-1
+// when the size is not known, as for stdin)
+bool load_in_progress();
+double load_fraction();
+
+// True while stdin is being read (jot -), and a way to stop: end_stream closes stdin and hands
+// over what was read, leaving `buf` complete and editable
+bool load_streaming();
+void end_stream(TextBuffer& buf);
+
+// True while stdin is being read but has paused, with everything it sent handed over to the buffer
+bool load_idle();
+
+// Stop a background load; the buffer keeps the part it already has
+void cancel_load();
+
+// The original ifstream/getline loader, kept as a baseline for load benchmarks
+bool load_file_getline(const string& filename, TextBuffer& buf, LoadStats* stats = nullptr);
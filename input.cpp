@@ -1,10 +1,31 @@
 #include "input.h"
-#include <iostream>
-#include <conio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "fileio.h"
+#include "regex.h"
 #include "undo.h"
 
 using namespace std;
 
+/**
+ * What a paste adds to a one-line prompt: the first line of the pasted text, without control
+ * characters. A line break in the paste ends the line the way Enter does.
+ *
+ * @param enter Set to true if the paste contains a line break, so the prompt should take it as Enter
+ * @return The printable text before the first line break
+ */
+static string pasted_line(bool& enter) {
+    const string& text = term_paste_text();
+    string line;
+    size_t i = 0;
+    for (; i < text.size() && text[i] != '\n'; ++i) {
+        if (text[i] >= 32 && text[i] <= 126) line += text[i];
+    }
+    enter = i < text.size();
+    return line;
+}
+
 /**
  * Single-line input with basic editing
  * 
@@ -12,18 +33,15 @@ using namespace std;
  * @param startCoord The starting coordinate for input
  * @return True if input was confirmed (Enter), false if cancelled (ESC)
  */
-bool input_line(string &out, const COORD &startCoord) {
+bool input_line(string &out, const ScreenPos &startCoord) {
     out.clear();
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (hOut == INVALID_HANDLE_VALUE) return false;
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (!GetConsoleScreenBufferInfo(hOut, &csbi)) return false;
-    COORD cur = startCoord;
-    SetConsoleCursorPosition(hOut, cur);
+    ScreenPos cur = startCoord;
+    screen_cursor(cur.x, cur.y);
+    screen_flush();
     while (true) {
-        int ch = _getch();
+        int ch = term_getch();
         if (ch == 0 || ch == 224) {
-            int s = _getch();
+            int s = term_getch();
             // Ignore arrows while editing
             continue;
         }
@@ -37,26 +55,219 @@ bool input_line(string &out, const COORD &startCoord) {
             if (!out.empty()) {
                 out.pop_back();
                 // Move cursor back and erase
-                if (cur.X > 0) cur.X = (SHORT)(cur.X - 1);
-                SetConsoleCursorPosition(hOut, cur);
-                cout << ' ';
-                SetConsoleCursorPosition(hOut, cur);
+                if (cur.x > 0) cur.x--;
+                screen_text(cur.x, cur.y, " ");
+                screen_cursor(cur.x, cur.y);
+                screen_flush();
             }
             continue;
         }
-        if (ch >= 32 && ch <= 126) {
-            char c = (char)ch;
-            out.push_back(c);
-            cout << c;
-            cur.X = (SHORT)(cur.X + 1);
+        if ((ch >= 32 && ch <= 126) || ch == TERM_PASTE) {
+            bool enter = false;
+            string text = ch == TERM_PASTE ? pasted_line(enter) : string(1, (char)ch);
+            out += text;
+            cur.x = screen_text(cur.x, cur.y, text);
+            screen_cursor(cur.x, cur.y);
+            screen_flush();
+            if (enter) return true;
         }
     }
 }
 
+/**
+ * Format a count with thousands separators (e.g. 1,204)
+ * 
+ * @param n The number to format
+ * @return The formatted number
+ */
+static string with_commas(size_t n) {
+    string digits = to_string(n), out;
+    for (size_t i = 0; i < digits.size(); ++i) {
+        if (i > 0 && (digits.size() - i) % 3 == 0) out.push_back(',');
+        out.push_back(digits[i]);
+    }
+    return out;
+}
+
+/**
+ * Describe the background count of matches for the prompt
+ * 
+ * @param search The background search counting the matches
+ * @param cur The selected match (line < 0 if none)
+ * @return e.g. "1,204 matches, scanning 43%...", "3 of 1,204" or "no matches"
+ */
+static string match_note(const BackgroundSearch &search, const Match &cur) {
+    size_t found;
+    double fraction;
+    const vector<Match> *all = nullptr;
+    if (!search.poll(found, fraction, all)) {
+        return with_commas(found) + (found == 1 ? " match" : " matches") + ", scanning " + to_string((int)(fraction * 100)) + "%...";
+    }
+    if (all->empty()) return "no matches";
+    if (cur.line < 0) return with_commas(all->size()) + " matches";
+    auto it = lower_bound(all->begin(), all->end(), cur, [](const Match &a, const Match &b) {
+        return a.line != b.line ? a.line < b.line : a.start < b.start;
+    });
+    return with_commas((size_t)(it - all->begin()) + 1) + " of " + with_commas(all->size());
+}
+
+/**
+ * Highlight the matches of `query` inside the viewport, with `cur` (if any) as the selected one.
+ * Only the visible lines are searched here; the total is counted by `search` in the background.
+ * 
+ * @param buf The text buffer being searched
+ * @param search Background count of all matches (started here if needed)
+ * @param query The search query
+ * @param re The query compiled as a regular expression, or null for literal text
+ * @param cur The selected match (line < 0 if none)
+ * @param row The current cursor row
+ * @param showLineNumbers Whether line numbers are shown
+ * @param reserveLines Number of prompt lines reserved above the text
+ * @param counting Set if `search` is counting the matches (so the note should follow it)
+ * @return Text describing the matches for the prompt (empty without a query)
+ */
+static string show_matches(const TextBuffer &buf, BackgroundSearch &search, const string &query, const shared_ptr<const Regex> &re, const Match &cur, int row, bool showLineNumbers, int reserveLines, bool &counting) {
+    counting = false;
+    if (query.empty()) return "";
+    if (re && !re->ok()) return "bad pattern: " + re->error();
+    int first, last;
+    visible_lines(row, reserveLines, first, last);
+    vector<Match> visible = find_in_lines(buf, query, (size_t)first, (size_t)last, re.get());
+    int sel = -1;
+    for (int i = 0; i < (int)visible.size(); ++i) {
+        if (visible[i].line == cur.line && visible[i].start == cur.start) sel = i;
+    }
+    highlight_matches_overlay(visible, buf, row, showLineNumbers, reserveLines, sel);
+    search.request(buf, query, re);
+    counting = true;
+    return match_note(search, cur);
+}
+
+/**
+ * Write `note` in parentheses at `pos` (after a prompt's input), blanking what a previous,
+ * longer note left behind
+ * 
+ * @param pos Where the note starts
+ * @param note The text to show
+ * @param oldLen Length of the note currently on screen, or 0
+ */
+static void prompt_note(ScreenPos pos, const string &note, size_t oldLen = 0) {
+    string text = note.empty() ? "" : "(" + note + ")";
+    if (text.size() < oldLen + 2) text.append(oldLen + 2 - text.size(), ' ');
+    screen_text(pos.x, pos.y, text);
+}
+
+// wait_key result when no key was read but more of a loading file came in, so the prompt redraws
+static const int LOAD_GREW = -1;
+
+/**
+ * Wait for a key, refreshing the match count in the prompt while the background search runs and
+ * adding the parts of a progressive load as they come in
+ * 
+ * @param buf The text buffer being searched
+ * @param search The background search (stopped before the buffer grows)
+ * @param counting Whether `search` is counting the current query's matches
+ * @param cur The selected match
+ * @param notePos Where the prompt's note is drawn
+ * @param inputPos Where the input cursor belongs
+ * @param note The note currently on screen (updated)
+ * @return The key read with term_getch, or LOAD_GREW if the buffer grew first
+ */
+static int wait_key(TextBuffer &buf, BackgroundSearch &search, bool counting, const Match &cur, ScreenPos notePos, ScreenPos inputPos, string &note) {
+    screen_cursor(inputPos.x, inputPos.y);
+    screen_flush();
+    while ((counting || load_in_progress()) && !term_kbhit()) {
+        if (load_ready()) { // the worker must not read the buffer while it grows; the redraw restarts it
+            search.stop();
+            poll_load(buf);
+            return LOAD_GREW;
+        }
+        if (counting) {
+            size_t found; double fraction; const vector<Match>* all;
+            bool done = search.poll(found, fraction, all);
+            string now = match_note(search, cur);
+            if (now != note) {
+                prompt_note(notePos, now, note.size());
+                note = now;
+                screen_flush();
+            }
+            if (done) counting = false; // the final count is up; nothing more to show until a key
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return term_getch();
+}
+
+/**
+ * Move the selection to the next (dir > 0) or previous (dir < 0) match and the cursor with it
+ * 
+ * @param buf The text buffer being searched
+ * @param query The search query
+ * @param re The query compiled as a regular expression, or null for literal text
+ * @param cur The selected match (updated)
+ * @param dir Direction to move in
+ * @param row The current cursor row (updated)
+ * @param col The current cursor column (updated)
+ */
+static void step_match(const TextBuffer &buf, const string &query, const Regex *re, Match &cur, int dir, int &row, int &col) {
+    if (cur.line < 0) return;
+    Match m;
+    bool found = dir > 0 ? find_next(buf, query, cur.line, cur.start + 1, m, re) : find_prev(buf, query, cur.line, cur.start, m, re);
+    if (!found) return;
+    cur = m;
+    row = m.line; col = m.start;
+}
+
+/**
+ * Select the first match of `query` at or after (row, col), or nothing if there is none
+ * 
+ * @param buf The text buffer being searched
+ * @param query The search query
+ * @param re The query compiled as a regular expression, or null for literal text
+ * @param row The row to search from
+ * @param col The column to search from
+ * @return The match, with line -1 if there is none
+ */
+static Match first_match(const TextBuffer &buf, const string &query, const Regex *re, int row, int col) {
+    Match m{-1, 0, 0};
+    if (!query.empty() && !find_next(buf, query, row, col, m, re)) m.line = -1;
+    return m;
+}
+
+/**
+ * Compile the query for a prompt, once per change of the query or of the mode
+ *
+ * @param query The search query
+ * @param regex Whether it is a regular expression
+ * @return The compiled expression, or null for literal text
+ */
+static shared_ptr<const Regex> compile_query(const string &query, bool regex) {
+    return regex ? make_shared<const Regex>(query) : nullptr;
+}
+
+/**
+ * Replacement text for a regex match, with $1-style references filled in from its groups
+ * 
+ * @param buf The text buffer holding the match
+ * @param re The regular expression that found it
+ * @param m The match
+ * @param repl The replacement template
+ * @param out Receives the expanded replacement
+ * @return False if the match is no longer there (so nothing should be replaced)
+ */
+static bool expand_match(const TextBuffer &buf, const Regex &re, const Match &m, const string &repl, string &out) {
+    RegexMatcher matcher(re);
+    string line = buf.line(m.line);
+    vector<int> caps;
+    if (!matcher.search(line.data(), line.size(), (size_t)m.start, caps) || caps[0] != m.start || caps[1] != m.start + m.len) return false;
+    out = re.expand(repl, line.data(), caps);
+    return true;
+}
+
 /**
  * Find mode: prompt for a search query, highlight matches, allow navigation, exit on ESC or Enter.
  * 
- * @param lines The text buffer to search
+ * @param buf The text buffer to search
  * @param row The current cursor row (updated on selection)
  * @param col The current cursor column (updated on selection)
  * @param filename The name of the file being edited
@@ -65,67 +276,75 @@ bool input_line(string &out, const COORD &startCoord) {
  * @param showGuide Whether the column guide is shown
  * @param guideCol The column number of the guide
  */
-void find_mode(vector<string> &lines, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol) {
+void find_mode(TextBuffer &buf, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol) {
     string query;
-    vector<Match> matches;
-    int sel = -1;
+    BackgroundSearch search;
+    int originRow = row, originCol = col; // new queries select the first match from here
+    Match cur{-1, 0, 0};
+    bool regex = false; // toggled with Tab
+    shared_ptr<const Regex> re;
+    // After the query or the mode changes: compile it and select its first match from the origin
+    auto changed = [&]() {
+        re = compile_query(query, regex);
+        cur = first_match(buf, query, re.get(), originRow, originCol);
+    };
     while (true) {
         int baseHeaderLines = (g_showTitle ? 1 : 0) + (g_showInfo ? 1 : 0);
         int reserveLines = 1;
-        render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, reserveLines);
+        render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, reserveLines);
         int headerLines = baseHeaderLines;
-        HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-        CONSOLE_SCREEN_BUFFER_INFO csbi;
-        GetConsoleScreenBufferInfo(hOut, &csbi);
-        COORD promptStart = {0, (SHORT)headerLines};
-        SetConsoleCursorPosition(hOut, promptStart);
-        cout << "Find: " << query;
-        DWORD written=0; COORD after = promptStart; after.X = (SHORT)(6 + query.size());
-        FillConsoleOutputCharacter(hOut, ' ', csbi.dwSize.X - after.X, after, &written);
-
-        matches = find_all(lines, query);
-        if (!matches.empty() && sel < 0) sel = 0;
-        if (matches.empty()) sel = -1;
-        highlight_matches_overlay(matches, lines, row, showLineNumbers, reserveLines, sel);
-
-        COORD inputPos = { (SHORT)(6 + query.size()), (SHORT)headerLines };
-        SetConsoleCursorPosition(hOut, inputPos);
-
-        int ch = _getch();
+        ScreenPos promptStart = {0, headerLines};
+        string label = regex ? "Regex: " : "Find: ";
+        ScreenPos after = promptStart; after.x = screen_text(0, promptStart.y, label + query);
+
+        bool counting;
+        string note = show_matches(buf, search, query, re, cur, row, showLineNumbers, reserveLines, counting);
+        ScreenPos notePos = {after.x + 2, after.y};
+        prompt_note(notePos, note);
+
+        ScreenPos inputPos = after;
+
+        int ch = wait_key(buf, search, counting, cur, notePos, inputPos, note);
         if (ch == 0 || ch == 224) {
-            int s = _getch();
+            int s = term_getch();
             if (s == 72) { // Up arrow -> Prev Match
-                if (!matches.empty()) {
-                    if (sel <= 0) sel = (int)matches.size() - 1; else sel--;
-                    row = matches[sel].line; col = matches[sel].start;
-                }
+                step_match(buf, query, re.get(), cur, -1, row, col);
             } else if (s == 80) { // Down -> Next
-                if (!matches.empty()) {
-                    sel = (sel + 1) % (int)matches.size();
-                    row = matches[sel].line; col = matches[sel].start;
-                }
+                step_match(buf, query, re.get(), cur, 1, row, col);
             }
             continue;
         }
         if (ch == 27) { // ESC cancel
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 0);
+            render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 0);
             break;
         }
+        if (ch == TERM_PASTE) { // a line break in the paste confirms like Enter
+            bool enter;
+            query += pasted_line(enter);
+            changed();
+            if (!enter) continue;
+            ch = 13;
+        }
         if (ch == 13) { // Enter - Leave Find with cursor at selection (if any)
-            if (!matches.empty()) {
-                if (sel < 0) sel = 0;
-                row = matches[sel].line; col = matches[sel].start;
+            if (cur.line >= 0) {
+                row = cur.line; col = cur.start;
             }
-            render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 0);
+            render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 0);
             break;
         }
+        if (ch == 9) { // Tab toggles between literal text and regular expressions
+            regex = !regex;
+            changed();
+            continue;
+        }
         if (ch == 8) { // Backspace while editing query
             if (!query.empty()) query.pop_back();
+            changed();
             continue;
         }
         if (ch >= 32 && ch <= 126) {
             query.push_back((char)ch);
-            sel = -1;
+            changed();
             continue;
         }
     }
@@ -133,8 +352,9 @@ void find_mode(vector<string> &lines, int &row, int &col, const string &filename
 
 /**
  * Replace mode: prompt for search and replacement strings, highlight matches, allow navigation and replacement.
+ * Ctrl+A in the replacement prompt replaces every match at once.
  * 
- * @param lines The text buffer to edit
+ * @param buf The text buffer to edit
  * @param row The current cursor row (updated on selection/replacement)
  * @param col The current cursor column (updated on selection/replacement)
  * @param filename The name of the file being edited
@@ -142,106 +362,120 @@ void find_mode(vector<string> &lines, int &row, int &col, const string &filename
  * @param showLineNumbers Whether line numbers are shown
  * @param showGuide Whether the column guide is shown
  * @param guideCol The column number of the guide
+ * @return A message for the status line (the Replace All count), or empty
  */
-void replace_mode(vector<string> &lines, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol) {
+string replace_mode(TextBuffer &buf, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol) {
     string query;
     string repl;
-    vector<Match> matches;
-    int sel = -1;
+    BackgroundSearch search;
+    int originRow = row, originCol = col;
+    Match cur{-1, 0, 0};
+    bool regex = false; // toggled with Tab
+    shared_ptr<const Regex> re;
+    auto changed = [&]() {
+        re = compile_query(query, regex);
+        cur = first_match(buf, query, re.get(), originRow, originCol);
+    };
 
     while (true) {
         int baseHeaderLines = (g_showTitle ? 1 : 0) + (g_showInfo ? 1 : 0);
         int reserveLines = 2;
-        render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, reserveLines);
+        render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, reserveLines);
         int headerLines = baseHeaderLines;
-        HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-        CONSOLE_SCREEN_BUFFER_INFO csbi;
-        GetConsoleScreenBufferInfo(hOut, &csbi);
-        COORD promptStart = {0, (SHORT)headerLines};
-        SetConsoleCursorPosition(hOut, promptStart);
-        cout << "Find: " << query;
-        DWORD written=0; COORD after = promptStart; after.X = (SHORT)(6 + query.size());
-        FillConsoleOutputCharacter(hOut, ' ', csbi.dwSize.X - after.X, after, &written);
-
-        matches = find_all(lines, query);
-        if (!matches.empty() && sel < 0) sel = 0;
-        if (matches.empty()) sel = -1;
-        highlight_matches_overlay(matches, lines, row, showLineNumbers, reserveLines, sel);
-
-        COORD inputPos = { (SHORT)(6 + query.size()), (SHORT)headerLines };
-        SetConsoleCursorPosition(hOut, inputPos);
-
-        int ch = _getch();
+        ScreenPos promptStart = {0, headerLines};
+        string label = regex ? "Regex: " : "Find: ";
+        ScreenPos after = promptStart; after.x = screen_text(0, promptStart.y, label + query);
+
+        bool counting;
+        string note = show_matches(buf, search, query, re, cur, row, showLineNumbers, reserveLines, counting);
+        ScreenPos notePos = {after.x + 2, after.y};
+        prompt_note(notePos, note);
+
+        ScreenPos inputPos = after;
+
+        int ch = wait_key(buf, search, counting, cur, notePos, inputPos, note);
         if (ch == 0 || ch == 224) {
-            int s = _getch();
+            int s = term_getch();
             if (s == 72) {
-                if (!matches.empty()) { sel = (sel <= 0) ? (int)matches.size()-1 : sel-1; row = matches[sel].line; col = matches[sel].start; }
+                step_match(buf, query, re.get(), cur, -1, row, col);
             } else if (s == 80) {
-                if (!matches.empty()) { sel = (sel + 1) % (int)matches.size(); row = matches[sel].line; col = matches[sel].start; }
+                step_match(buf, query, re.get(), cur, 1, row, col);
             }
             continue;
         }
-        if (ch == 27) { render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 0); return; }
+        if (ch == 27) { render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, 0); return ""; }
+        if (ch == TERM_PASTE) {
+            bool enter;
+            query += pasted_line(enter);
+            changed();
+            if (!enter) continue;
+            ch = 13;
+        }
         if (ch == 13) { break; }
-        if (ch == 8) { if (!query.empty()) query.pop_back(); continue; }
-        if (ch >= 32 && ch <= 126) { query.push_back((char)ch); sel = -1; continue; }
+        if (ch == 9) { regex = !regex; changed(); continue; }
+        if (ch == 8) { if (!query.empty()) query.pop_back(); changed(); continue; }
+        if (ch >= 32 && ch <= 126) { query.push_back((char)ch); changed(); continue; }
     }
 
-    if (query.empty()) return;
+    if (query.empty()) return "";
 
     repl.clear();
-    sel = -1;
-    matches = find_all(lines, query);
+    if (cur.line < 0) cur = first_match(buf, query, re.get(), row, col);
     while (true) {
         int baseHeaderLines = (g_showTitle ? 1 : 0) + (g_showInfo ? 1 : 0);
         int reserveLines = 2;
-        render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, reserveLines);
+        render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, reserveLines);
         int headerLines = baseHeaderLines;
-        HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-        CONSOLE_SCREEN_BUFFER_INFO csbi;
-        GetConsoleScreenBufferInfo(hOut, &csbi);
-        COORD findPos = {0, (SHORT)headerLines};
-        SetConsoleCursorPosition(hOut, findPos);
-        cout << "Find: " << query;
-        COORD replPos = {0, (SHORT)(headerLines + 1)};
-        SetConsoleCursorPosition(hOut, replPos);
-        cout << "Replace: " << repl;
-        DWORD written=0; COORD after = replPos; after.X = (SHORT)(9 + repl.size());
-        FillConsoleOutputCharacter(hOut, ' ', csbi.dwSize.X - after.X, after, &written);
-
-        matches = find_all(lines, query);
-        if (!matches.empty() && sel < 0) sel = 0;
-        if (matches.empty()) sel = -1;
-        highlight_matches_overlay(matches, lines, row, showLineNumbers, reserveLines, sel);
-
-        COORD inputPos = { (SHORT)(9 + repl.size()), (SHORT)(headerLines + 1) };
-        SetConsoleCursorPosition(hOut, inputPos);
-
-        int ch = _getch();
+        ScreenPos findPos = {0, headerLines};
+        string label = regex ? "Regex: " : "Find: ";
+        screen_text(0, findPos.y, label + query);
+        screen_text(0, headerLines + 1, "Replace: " + repl);
+
+        bool counting;
+        string note = show_matches(buf, search, query, re, cur, row, showLineNumbers, reserveLines, counting);
+        ScreenPos notePos = {(int)(label.size() + query.size() + 2), findPos.y};
+        prompt_note(notePos, note);
+
+        ScreenPos inputPos = { (int)(9 + repl.size()), headerLines + 1 };
+
+        int ch = wait_key(buf, search, counting, cur, notePos, inputPos, note);
         if (ch == 0 || ch == 224) {
-            int s = _getch();
+            int s = term_getch();
             if (s == 72) { // Up -> Prev Match
-                if (!matches.empty()) { sel = (sel <= 0) ? (int)matches.size()-1 : sel-1; row = matches[sel].line; col = matches[sel].start; }
+                step_match(buf, query, re.get(), cur, -1, row, col);
             } else if (s == 80) { // Down -> Next Match
-                if (!matches.empty()) { sel = (sel + 1) % (int)matches.size(); row = matches[sel].line; col = matches[sel].start; }
+                step_match(buf, query, re.get(), cur, 1, row, col);
             }
             continue;
         }
-        if (ch == 27) { render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol); return; }
+        if (ch == 27) { render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol); return ""; }
+        if (ch == 1) { // Ctrl+A - Replace All, as one undo step
+            search.stop();
+            size_t count = replace_all(buf, query, repl, regex, row, col);
+            if (row >= (int)buf.line_count()) row = (int)buf.line_count() - 1;
+            if (col > (int)buf.line_length(row)) col = (int)buf.line_length(row);
+            return "Replaced " + with_commas(count) + (count == 1 ? " match" : " matches");
+        }
+        if (ch == TERM_PASTE) {
+            bool enter;
+            repl += pasted_line(enter);
+            if (!enter) continue;
+            ch = 13;
+        }
         if (ch == 13) {
-            if (!matches.empty()) {
-                if (sel < 0) sel = 0;
-                Match m = matches[sel];
-                push_undo(lines, row, col);
-                string &ln = lines[m.line];
-                string left = ln.substr(0, m.start);
-                string right = ln.substr(m.start + m.len);
-                ln = left + repl + right;
+            string text = repl;
+            if (cur.line >= 0 && (!re || expand_match(buf, *re, cur, repl, text))) {
+                Match m = cur;
+                search.stop(); // the worker must not read the buffer while it changes
+                begin_undo_group(row, col);
+                erase_text(buf, m.line, m.start, m.len, row, col);
+                insert_text(buf, m.line, m.start, text, row, col);
+                end_undo_group();
                 row = m.line;
-                col = (int)left.size() + (int)repl.size();
+                col = m.start + (int)text.size();
+                // Continue with the next match after the replacement
+                cur = first_match(buf, query, re.get(), row, col);
             }
-            matches = find_all(lines, query);
-            sel = -1;
             continue;
         }
         if (ch == 8) { if (!repl.empty()) repl.pop_back(); continue; }
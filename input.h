@@ -2,7 +2,6 @@
 
 #include <string>
 #include <vector>
-#include <windows.h>
 #include "util.h"
 #include "display.h"
 
@@ -14,8 +13,8 @@ extern bool g_showTitle;
 extern bool g_showInfo;
 
 // Single-line input with basic editing
-bool input_line(string &out, const COORD &startCoord);
+bool input_line(string &out, const ScreenPos &startCoord);
 
-// Find and Replace modes
-void find_mode(vector<string> &lines, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol);
-void replace_mode(vector<string> &lines, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol);
+// Find and Replace modes; replace_mode returns a status message (e.g. the Replace All count) or ""
+void find_mode(TextBuffer &buf, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol);
+string replace_mode(TextBuffer &buf, int &row, int &col, const string &filename, bool unixMode, bool showLineNumbers, bool showGuide, int guideCol);
@@ -1,10 +1,8 @@
 #include <algorithm>
-#include <conio.h>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
-#include <windows.h>
 
 #include "fileio.h"
 #include "undo.h"
@@ -12,6 +10,8 @@
 #include "display.h"
 #include "input.h"
 #include "editor.h"
+#include "profile.h"
+#include "replay.h"
 
 using namespace std;
 
@@ -19,24 +19,9 @@ using namespace std;
 volatile bool g_ignoreCtrlC = true;
 bool g_showTitle = true;
 bool g_showInfo = true;
-
-/**
- * Console control handler to manage Ctrl+C behavior.
- *
- * @param signal The control signal received
- * @return TRUE to ignore the signal, FALSE to allow default handling
- */
-BOOL WINAPI ConsoleHandler(DWORD signal) {
-    if (signal == CTRL_C_EVENT) {
-        // Ignore default termination so Ctrl+C can be used as editor command
-        if (g_ignoreCtrlC) {
-            return TRUE;
-        } else {
-            return FALSE;
-        }
-    }
-    return FALSE;
-}
+bool g_saveInPlace = false;
+int g_maxFps = 0;
+bool g_follow = false;
 
 /**
  * Main function - entry point of Jot.
@@ -50,14 +35,7 @@ int main(int argc, char** argv) {
     string filename;
 
     // Initial content (single empty line by default)
-    vector<string> lines(1, "");
-
-    // Make Cursor Visible
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    CONSOLE_CURSOR_INFO cci;
-    GetConsoleCursorInfo(hOut, &cci);
-    cci.bVisible = TRUE;
-    SetConsoleCursorInfo(hOut, &cci);
+    TextBuffer buf;
 
     int row = 0, col = 0;
     string clipboard;
@@ -67,6 +45,9 @@ int main(int argc, char** argv) {
     bool showLineNumbers = true;
     bool showGuide = true;
     int guideCol = 90;
+    int undoBudgetMB = 16;
+    string replayScript; // -r: play this keystroke script headless instead of reading the keyboard
+    string profileFile = "jot_profile.txt"; // -p: where the latency summary is written at exit
 
     // Parse args: accept combined short flags like -itu and -g with optional value
 
@@ -77,11 +58,14 @@ int main(int argc, char** argv) {
         string a = argv[i];
         if (a.empty()) continue;
 
-        // If token is exactly "-g", skip it and its value (next token) entirely
-        if (a == "-g") { if (i + 1 < argc) ++i; continue; }
+        // If token is exactly "-g", "-m", "-f" or "-r", skip it and its value (next token) entirely
+        if (a == "-g" || a == "-m" || a == "-f" || a == "-r") { if (i + 1 < argc) ++i; continue; }
+
+        // If token starts with -g, -m, -f or -r (like -g80 or -m=64), skip this token
+        if (a.size() > 1 && a[0] == '-' && (a[1] == 'g' || a[1] == 'm' || a[1] == 'f' || a[1] == 'r')) continue;
 
-        // If token starts with -g (like -g80 or -g=80), skip this token
-        if (a.size() > 1 && a[0] == '-' && a[1] == 'g') continue;
+        // -p=<file>: the file name is not flags
+        if (a.rfind("-p=", 0) == 0) continue;
 
         // Only consider tokens that start with '-'
         if (a.size() >= 2 && a[0] == '-') {
@@ -98,14 +82,22 @@ int main(int argc, char** argv) {
     }
     if (wantHelp) {
         if(wantVersion) cout << "\n";
-        cout << "Jot - Minimal Terminal Text Editor for Windows\n";
-        cout << "Usage: jot.exe [-u] [-n] [-g <col>] [-i] [-t] [-h] [-v] [filename]\n\n";
+        cout << "Jot - Minimal Terminal Text Editor for Windows and Linux\n";
+        cout << "Usage: jot.exe [-u] [-n] [-d] [-F] [-g <col>] [-m <MB>] [-f <fps>] [-r <script>] [-p[=<file>]] [-i] [-t] [-h] [-v] [filename | -]\n\n";
         cout << "Flags:\n";
+        cout << "  -d                    Save small same-length edits in place (changed bytes only; not crash-safe)\n";
+        cout << "  -F                    Follow: keep the cursor on the last line while piped input (jot -) arrives\n";
+        cout << "  -f <fps> | -f=<fps>   Redraw at most <fps> times per second (default: as often as input allows)\n";
         cout << "  -g <col> | -g=<col>   Enable vertical guide at column <col> (default 90)\n";
         cout << "  -i                    Show the info/keybindings line\n";
+        cout << "  -m <MB> | -m=<MB>     Undo history memory budget (default 16); older history spills to disk\n";
         cout << "  -n                    Enable line numbers\n";
+        cout << "  -p | -p=<file>        Profile key latency per stage; summary on the bottom line, written to <file> at exit\n";
+        cout << "  -r <script>           Replay a keystroke script headless; print the final text and a latency report\n";
         cout << "  -t                    Hide the title line\n";
         cout << "  -u                    Unix Mode (Ctrl+C acts like SIGINT; copy becomes Ctrl+K)\n";
+        cout << "  -                     Read the text from stdin, e.g. `journalctl | jot -`; it keeps arriving while the pipe is open.\n";
+        cout << "                        Ctrl+S saves what has arrived so far; Ctrl+E stops reading so the text can be edited\n";
         cout << "Special Flags:\n";
         cout << "  -h                    Show this help and exit\n";
         cout << "  -v                    Show version (build date) and exit\n";
@@ -118,10 +110,11 @@ int main(int argc, char** argv) {
     // Currently: -u (Unix mode) affects Ctrl-C handling.
     for (int i = 1; i < argc; ++i) {
         string a = argv[i];
+        if (a.rfind("-p=", 0) == 0) continue;
         if (a.size() >= 2 && a[0] == '-') {
             for (size_t j = 1; j < a.size(); ++j) {
                 char ch = a[j];
-                if (ch == 'g') break; // -g consumes rest
+                if (ch == 'g' || ch == 'm' || ch == 'f' || ch == 'r') break; // -g/-m/-f/-r consume rest
                 if (ch == 'u') unixMode = true;
             }
         }
@@ -145,6 +138,41 @@ int main(int argc, char** argv) {
                 if (!num.empty()) guideCol = stoi(num);
                 continue;
             }
+            // Handle -m=val or -mval
+            if (a.rfind("-m=", 0) == 0) {
+                string num = a.substr(3);
+                if (!num.empty()) undoBudgetMB = stoi(num);
+                continue;
+            }
+            if (a.size() > 2 && a[1] == 'm') {
+                undoBudgetMB = stoi(a.substr(2));
+                continue;
+            }
+            // Handle -f=val or -fval
+            if (a.rfind("-f=", 0) == 0) {
+                string num = a.substr(3);
+                if (!num.empty()) g_maxFps = stoi(num);
+                continue;
+            }
+            if (a.size() > 2 && a[1] == 'f') {
+                g_maxFps = stoi(a.substr(2));
+                continue;
+            }
+            // Handle -p=file (plain -p is an ordinary flag below)
+            if (a.rfind("-p=", 0) == 0) {
+                g_profile = true;
+                if (a.size() > 3) profileFile = a.substr(3);
+                continue;
+            }
+            // Handle -r=script or -rscript
+            if (a.rfind("-r=", 0) == 0) {
+                replayScript = a.substr(3);
+                continue;
+            }
+            if (a.size() > 2 && a[1] == 'r') {
+                replayScript = a.substr(2);
+                continue;
+            }
 
             // Iterate short flags: e.g. -tiu
             for (size_t j = 1; j < a.size(); ++j) {
@@ -152,6 +180,9 @@ int main(int argc, char** argv) {
                 switch (f) {
                     case 'u': unixMode = true; break; // already applied in pass 2 too
                     case 'n': showLineNumbers = true; break;
+                    case 'd': g_saveInPlace = true; break; // In-place saves of changed ranges
+                    case 'p': g_profile = true; break; // Latency profiling
+                    case 'F': g_follow = true; break; // Follow streamed input
                     case 'i': g_showInfo = true; break; // Show info line
                     case 't': g_showTitle = false; break; // Hide title
                     case 'g': {
@@ -169,6 +200,30 @@ int main(int argc, char** argv) {
                         j = a.size();
                         break;
                     }
+                    case 'm': {
+                        // -m Followed By Number in same token or next arg
+                        string rest = a.substr(j+1);
+                        if (!rest.empty()) undoBudgetMB = stoi(rest);
+                        else if (i + 1 < argc) undoBudgetMB = stoi(argv[++i]);
+                        j = a.size();
+                        break;
+                    }
+                    case 'f': {
+                        // -f Followed By Number in same token or next arg
+                        string rest = a.substr(j+1);
+                        if (!rest.empty()) g_maxFps = stoi(rest);
+                        else if (i + 1 < argc) g_maxFps = stoi(argv[++i]);
+                        j = a.size();
+                        break;
+                    }
+                    case 'r': {
+                        // -r Followed By the script in the same token or next arg
+                        string rest = a.substr(j+1);
+                        if (!rest.empty()) replayScript = rest;
+                        else if (i + 1 < argc) replayScript = argv[++i];
+                        j = a.size();
+                        break;
+                    }
                     default:
                         // Unknown Flag - Ignore
                         break;
@@ -181,22 +236,56 @@ int main(int argc, char** argv) {
         if (filename.empty()) filename = a;
     }
 
-    // Install Ctrl Handler to avoid process termination on Ctrl+C
-    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
-
     // Set Ctrl-C handling according to mode (Unix-like: let Ctrl+C behave normally)
     g_ignoreCtrlC = !unixMode;
 
-    // If the user provided a filename, attempt to open and load it now
-    if (!filename.empty()) {
-        load_file(filename, lines);
+    // Raw keyboard input with a visible cursor; Ctrl+C stays a key unless in Unix mode. A replay
+    // uses a virtual window and the script's keys instead.
+    if (!replayScript.empty()) {
+        string error;
+        if (!replay_start(replayScript, error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+    } else {
+        term_init();
+    }
+
+    // Undo history beyond the budget is compressed to a temporary file instead of dropped
+    set_undo_budget((size_t)max(1, undoBudgetMB) << 20);
+
+    // If the user provided a filename, attempt to open and load it now. A large file streams in
+    // behind the first screen; a replay loads it whole so every run sees the same text.
+    if (filename == "-") {
+        // Text piped in: read for as long as the pipe is open; saving asks for a name. A replay
+        // starts once the input pauses, so its script can act on a stream that is still open.
+        filename.clear();
+        if (load_stdin_async(buf) && !replayScript.empty()) wait_for_load(buf, true);
+        if (g_follow) row = (int)buf.line_count() - 1;
+    } else if (!filename.empty()) {
+        if (replayScript.empty()) load_file_async(filename, buf);
+        else load_file(filename, buf);
     }
 
     // Initial render with selected options
-    render(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol);
+    render(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol);
+    screen_flush();
 
     // Run main editor loop
-    run_editor(lines, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, clipboard);
+    run_editor(buf, row, col, filename, unixMode, showLineNumbers, showGuide, guideCol, clipboard);
+
+    // Let any background save finish before exiting; a load still running is dropped
+    cancel_load();
+    wait_for_saves();
+
+    if (g_profile && !profile_write(profileFile)) cerr << "Cannot write profile to " << profileFile << "\n";
+
+    // A replay prints the resulting text to stdout and the latency report to stderr
+    if (!replayScript.empty()) {
+        cout << buf.text();
+        replay_report(cerr);
+        return 0;
+    }
 
     // Clear the console so it appears as if `cls` or `clear` was run after exit.
     clear_console();
@@ -0,0 +1,191 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+bool g_profile = false;
+
+static const char* STAGE_NAMES[STAGE_COUNT] = {"input", "edit", "undo", "search", "render", "key"};
+
+// Buckets 0-3 hold 0-3 ns; above that each octave [2^e, 2^(e+1)) is split into four
+static const int BUCKETS = 160;
+
+struct Histogram {
+    atomic<uint64_t> buckets[BUCKETS];
+    atomic<uint64_t> count;
+    atomic<uint64_t> total;
+    atomic<uint64_t> max;
+};
+
+// Zero-initialised as a static, so samples can be added before main runs
+static Histogram histograms[STAGE_COUNT];
+
+static atomic<uint64_t> allocations{0};
+static uint64_t keyStart = 0; // when the oldest key not shown yet was read, 0 for none
+
+/**
+ * Histogram bucket of a duration
+ *
+ * @param ns The duration in nanoseconds
+ * @return The bucket index
+ */
+static int bucket_of(uint64_t ns) {
+    if (ns < 4) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);
+    return min(BUCKETS - 1, 4 * (e - 1) + (int)((ns >> (e - 2)) & 3));
+}
+
+/**
+ * Middle of the durations that fall in a bucket
+ *
+ * @param b The bucket index
+ * @return A representative duration in nanoseconds
+ */
+static double bucket_mid(int b) {
+    if (b < 4) return b;
+    int e = b / 4 + 1;
+    double low = (double)(4 + b % 4) * (double)(1ull << (e - 2));
+    return low + (double)(1ull << (e - 2)) / 2;
+}
+
+/**
+ * Monotonic time
+ *
+ * @return Nanoseconds since an arbitrary start
+ */
+uint64_t profile_now() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Add a sample to a stage's histogram. Safe to call from any thread.
+ *
+ * @param stage The stage
+ * @param ns How long it took in nanoseconds
+ */
+void profile_add(ProfileStage stage, uint64_t ns) {
+    Histogram& h = histograms[stage];
+    h.buckets[bucket_of(ns)].fetch_add(1, memory_order_relaxed);
+    h.count.fetch_add(1, memory_order_relaxed);
+    h.total.fetch_add(ns, memory_order_relaxed);
+    uint64_t m = h.max.load(memory_order_relaxed);
+    while (ns > m && !h.max.compare_exchange_weak(m, ns, memory_order_relaxed)) {}
+}
+
+/**
+ * Note that a key was read. Keys read before the next frame count from the first of them.
+ */
+void profile_key_read() {
+    if (g_profile && keyStart == 0) keyStart = profile_now();
+}
+
+/**
+ * Note that a frame was written (or no frame is coming), ending the latency of the keys before it.
+ */
+void profile_key_shown() {
+    if (keyStart == 0) return;
+    profile_add(STAGE_KEY, profile_now() - keyStart);
+    keyStart = 0;
+}
+
+/**
+ * A percentile of a stage's samples, from its histogram
+ *
+ * @param stage The stage
+ * @param p The fraction of samples at or below the result (0.5 for the median)
+ * @return The duration in milliseconds, or 0 without samples
+ */
+static double percentile_ms(ProfileStage stage, double p) {
+    const Histogram& h = histograms[stage];
+    uint64_t n = h.count.load(memory_order_relaxed);
+    if (n == 0) return 0;
+    uint64_t want = max<uint64_t>(1, (uint64_t)(p * n + 0.5)), seen = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        seen += h.buckets[b].load(memory_order_relaxed);
+        if (seen >= want) return min(bucket_mid(b), (double)h.max.load(memory_order_relaxed)) / 1e6;
+    }
+    return h.max.load(memory_order_relaxed) / 1e6;
+}
+
+/**
+ * Count a heap allocation (called by the operator new in alloc_count.cpp while profiling)
+ */
+void profile_count_allocation() {
+    allocations.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * Number of heap allocations so far
+ *
+ * @return The count of operator new calls
+ */
+uint64_t profile_allocations() {
+    return allocations.load(memory_order_relaxed);
+}
+
+/**
+ * Summary for the status line, e.g. "key p50 0.21 ms p99 3.40 ms | render p99 0.90 ms | 12 allocs/key,
+ * 5210 total". The stage named is the one with the worst p99; allocations per key are averaged
+ * over the keys since the last call.
+ *
+ * @return The summary
+ */
+string profile_status() {
+    static uint64_t lastAllocs = 0, lastKeys = 0;
+    uint64_t allocs = profile_allocations(), keys = histograms[STAGE_KEY].count.load(memory_order_relaxed);
+    static uint64_t perKey = 0;
+    if (keys > lastKeys) {
+        perKey = (allocs - lastAllocs) / (keys - lastKeys);
+        lastAllocs = allocs;
+        lastKeys = keys;
+    }
+    // The stage other than the whole key with the worst p99
+    int worst = STAGE_INPUT;
+    for (int s = STAGE_INPUT; s < STAGE_KEY; ++s) {
+        if (percentile_ms((ProfileStage)s, 0.99) > percentile_ms((ProfileStage)worst, 0.99)) worst = s;
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "key p50 %.2f ms p99 %.2f ms | %s p99 %.2f ms | %llu allocs/key, %llu total",
+             percentile_ms(STAGE_KEY, 0.5), percentile_ms(STAGE_KEY, 0.99), STAGE_NAMES[worst],
+             percentile_ms((ProfileStage)worst, 0.99), (unsigned long long)perKey, (unsigned long long)allocs);
+    return line;
+}
+
+/**
+ * Write the profile: for each stage the sample count, mean, p50/p90/p99/max and total time,
+ * then the non-empty histogram buckets.
+ *
+ * @param path The file to write
+ * @return True if it was written
+ */
+bool profile_write(const string& path) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "Jot latency profile (ms)\n");
+    fprintf(f, "%-8s %10s %10s %10s %10s %10s %10s %12s\n", "stage", "count", "mean", "p50", "p90", "p99", "max", "total");
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        const Histogram& h = histograms[s];
+        uint64_t n = h.count.load(memory_order_relaxed);
+        double total = h.total.load(memory_order_relaxed) / 1e6;
+        fprintf(f, "%-8s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %12.3f\n", STAGE_NAMES[s], (unsigned long long)n,
+                n ? total / n : 0.0, percentile_ms((ProfileStage)s, 0.5), percentile_ms((ProfileStage)s, 0.9),
+                percentile_ms((ProfileStage)s, 0.99), h.max.load(memory_order_relaxed) / 1e6, total);
+    }
+    uint64_t keys = histograms[STAGE_KEY].count.load(memory_order_relaxed);
+    fprintf(f, "\nheap allocations: %llu (%llu per key)\n", (unsigned long long)profile_allocations(),
+            (unsigned long long)(keys ? profile_allocations() / keys : 0));
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        const Histogram& h = histograms[s];
+        if (h.count.load(memory_order_relaxed) == 0) continue;
+        fprintf(f, "\n%s histogram (ms: samples)\n", STAGE_NAMES[s]);
+        for (int b = 0; b < BUCKETS; ++b) {
+            uint64_t c = h.buckets[b].load(memory_order_relaxed);
+            if (c) fprintf(f, "  %12.4f: %llu\n", bucket_mid(b) / 1e6, (unsigned long long)c);
+        }
+    }
+    return fclose(f) == 0;
+}
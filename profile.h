@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Latency profiling (-p). Each stage of handling a key records how long it took into a histogram
+// with buckets a quarter of an octave wide, so recording is a few atomic increments and the
+// percentiles come out within about 12%. Heap allocations are counted while profiling, by an
+// operator new (alloc_count.cpp) that only the editor links.
+
+// Whether stages are being timed (-p)
+extern bool g_profile;
+
+// What the time is spent on
+enum ProfileStage {
+    STAGE_INPUT,  // reading and decoding a key, once one has arrived
+    STAGE_EDIT,   // changing the buffer
+    STAGE_UNDO,   // recording, undoing and redoing edits
+    STAGE_SEARCH, // find_all and the searches for the visible lines
+    STAGE_RENDER, // composing a frame and writing it to the terminal
+    STAGE_KEY,    // from reading a key to the end of the frame that shows its effect
+    STAGE_COUNT
+};
+
+// Monotonic time in nanoseconds
+uint64_t profile_now();
+
+// Record that `stage` took `ns` nanoseconds
+void profile_add(ProfileStage stage, uint64_t ns);
+
+// Times the scope it lives in as one sample of `stage`, if profiling is on
+class ProfileTimer {
+public:
+    explicit ProfileTimer(ProfileStage stage) : stage_(stage), start_(g_profile ? profile_now() : 0) {}
+    ~ProfileTimer() { if (start_) profile_add(stage_, profile_now() - start_); }
+    ProfileTimer(const ProfileTimer&) = delete;
+    ProfileTimer& operator=(const ProfileTimer&) = delete;
+private:
+    ProfileStage stage_;
+    uint64_t start_;
+};
+
+// Key latency (STAGE_KEY): a key was read; and the frame showing the keys read since is out
+void profile_key_read();
+void profile_key_shown();
+
+// Count one heap allocation, and the allocations counted since profiling started
+void profile_count_allocation();
+uint64_t profile_allocations();
+
+// One-line summary for the status line: key latency p50/p99, the slowest stage and allocations
+string profile_status();
+
+// Write every stage's count, mean, percentiles and histogram to `path`; false if it cannot be written
+bool profile_write(const string& path);
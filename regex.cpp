@@ -0,0 +1,769 @@
+#include "regex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+
+using namespace std;
+
+// Upper bound for {m,n} counts and for the compiled program, to keep expansion in check
+static const int MAX_REPEAT = 1000;
+static const size_t MAX_PROGRAM = 100000;
+
+// Upper bound for instructions × capture slots: each thread list holds that many offsets
+static const size_t MAX_THREAD_SLOTS = 1u << 22;
+
+// DFA states cached per matcher before the cache is thrown away and rebuilt
+static const size_t MAX_DSTATES = 2048;
+
+// ---- Parsing ----
+
+// Syntax tree produced by the parser; children are indices into RxParser::nodes
+struct RxNode {
+    enum Kind { EMPTY, SET, CAT, ALT, REPEAT, GROUP, BOL, EOL } kind;
+    explicit RxNode(Kind k) : kind(k) {}
+    bitset<256> set;  // SET: bytes matched
+    vector<int> kids; // CAT, ALT: parts; REPEAT, GROUP: the one child
+    int min = 0, max = 0; // REPEAT: bounds (max -1 = unbounded)
+    bool greedy = true;
+    int group = -1;   // GROUP: capture index (1-based), -1 if not capturing
+};
+
+struct RxParser {
+    const string& s;
+    size_t i = 0;
+    vector<RxNode> nodes;
+    int groups = 0;
+    string error;
+
+    explicit RxParser(const string& pattern) : s(pattern) {}
+
+    int add(RxNode n) {
+        nodes.push_back(move(n));
+        return (int)nodes.size() - 1;
+    }
+
+    int fail(const string& msg) {
+        if (error.empty()) error = msg;
+        return -1;
+    }
+
+    bool more() const { return i < s.size(); }
+
+    static bitset<256> range(int lo, int hi) {
+        bitset<256> b;
+        for (int c = lo; c <= hi; ++c) b.set(c);
+        return b;
+    }
+
+    // \d \w \s and friends; returns false if `c` is not a class escape
+    static bool class_escape(char c, bitset<256>& out) {
+        switch (c) {
+            case 'd': out = range('0', '9'); return true;
+            case 'w': out = range('0', '9') | range('A', 'Z') | range('a', 'z'); out.set('_'); return true;
+            case 's': out.reset(); for (char w : string(" \t\r\n\f\v")) out.set((unsigned char)w); return true;
+            case 'D': class_escape('d', out); out.flip(); return true;
+            case 'W': class_escape('w', out); out.flip(); return true;
+            case 'S': class_escape('s', out); out.flip(); return true;
+        }
+        return false;
+    }
+
+    // Single byte named by an escape (after the backslash), or -1 if unsupported
+    int byte_escape() {
+        char c = s[i++];
+        switch (c) {
+            case 't': return '\t';
+            case 'n': return '\n';
+            case 'r': return '\r';
+            case 'f': return '\f';
+            case 'v': return '\v';
+            case '0': return 0;
+            case 'x': {
+                int v = 0;
+                for (int k = 0; k < 2; ++k) {
+                    if (!more() || !isxdigit((unsigned char)s[i])) return -1;
+                    char h = s[i++];
+                    v = v * 16 + (isdigit((unsigned char)h) ? h - '0' : (tolower((unsigned char)h) - 'a' + 10));
+                }
+                return v;
+            }
+        }
+        if (isalnum((unsigned char)c)) return -1;
+        return (unsigned char)c; // escaped punctuation stands for itself
+    }
+
+    int parse_alt() {
+        vector<int> parts{parse_cat()};
+        while (parts.back() >= 0 && more() && s[i] == '|') {
+            ++i;
+            parts.push_back(parse_cat());
+        }
+        if (parts.back() < 0) return -1;
+        if (parts.size() == 1) return parts[0];
+        RxNode n{RxNode::ALT};
+        n.kids = parts;
+        return add(n);
+    }
+
+    int parse_cat() {
+        RxNode n{RxNode::CAT};
+        while (more() && s[i] != '|' && s[i] != ')') {
+            int k = parse_repeat();
+            if (k < 0) return -1;
+            n.kids.push_back(k);
+        }
+        if (n.kids.empty()) return add(RxNode{RxNode::EMPTY});
+        if (n.kids.size() == 1) return n.kids[0];
+        return add(n);
+    }
+
+    // Reads "{m}", "{m,}" or "{m,n}" at s[i]; leaves i alone and returns false if it is not one
+    bool parse_braces(int& lo, int& hi) {
+        size_t j = i + 1;
+        auto number = [&](int& v) {
+            size_t start = j;
+            long x = 0;
+            while (j < s.size() && isdigit((unsigned char)s[j])) x = min(x * 10 + (s[j++] - '0'), (long)INT_MAX);
+            v = (int)x;
+            return j > start;
+        };
+        if (!number(lo)) return false;
+        hi = lo;
+        if (j < s.size() && s[j] == ',') {
+            ++j;
+            if (!number(hi)) hi = -1;
+        }
+        if (j >= s.size() || s[j] != '}') return false;
+        i = j + 1;
+        return true;
+    }
+
+    int parse_repeat() {
+        int atom = parse_atom();
+        while (atom >= 0 && more()) {
+            int lo, hi;
+            char c = s[i];
+            if (c == '*') { lo = 0; hi = -1; ++i; }
+            else if (c == '+') { lo = 1; hi = -1; ++i; }
+            else if (c == '?') { lo = 0; hi = 1; ++i; }
+            else if (c == '{' && parse_braces(lo, hi)) {
+                if (lo > MAX_REPEAT || hi > MAX_REPEAT) return fail("repeat count too large");
+                if (hi >= 0 && hi < lo) return fail("bad repeat range");
+            } else break;
+            RxNode n{RxNode::REPEAT};
+            n.kids = {atom};
+            n.min = lo;
+            n.max = hi;
+            if (more() && s[i] == '?') { n.greedy = false; ++i; }
+            RxNode::Kind k = nodes[atom].kind;
+            if (k == RxNode::BOL || k == RxNode::EOL || k == RxNode::EMPTY) return fail("nothing to repeat");
+            atom = add(n);
+        }
+        return atom;
+    }
+
+    int parse_class() {
+        bitset<256> set;
+        bool negate = false;
+        if (more() && s[i] == '^') { negate = true; ++i; }
+        bool first = true;
+        while (true) {
+            if (!more()) return fail("missing ]");
+            char c = s[i];
+            if (c == ']' && !first) { ++i; break; }
+            first = false;
+            int lo;
+            if (c == '\\') {
+                ++i;
+                if (!more()) return fail("trailing \\");
+                bitset<256> esc;
+                if (class_escape(s[i], esc)) { set |= esc; ++i; continue; }
+                lo = byte_escape();
+                if (lo < 0) return fail("unsupported escape");
+            } else {
+                lo = (unsigned char)c;
+                ++i;
+            }
+            int hi = lo;
+            if (i + 1 < s.size() && s[i] == '-' && s[i + 1] != ']') {
+                ++i;
+                if (s[i] == '\\') {
+                    ++i;
+                    if (!more()) return fail("trailing \\");
+                    hi = byte_escape();
+                    if (hi < 0) return fail("unsupported escape");
+                } else {
+                    hi = (unsigned char)s[i++];
+                }
+                if (hi < lo) return fail("bad class range");
+            }
+            set |= range(lo, hi);
+        }
+        if (negate) { set.flip(); set.reset('\n'); }
+        RxNode n{RxNode::SET};
+        n.set = set;
+        return add(n);
+    }
+
+    int parse_atom() {
+        char c = s[i++];
+        RxNode n{RxNode::SET};
+        switch (c) {
+            case '(': {
+                int group = -1;
+                if (s.compare(i, 2, "?:") == 0) i += 2;
+                else group = ++groups;
+                int inner = parse_alt();
+                if (inner < 0) return -1;
+                if (!more() || s[i] != ')') return fail("missing )");
+                ++i;
+                RxNode g{RxNode::GROUP};
+                g.kids = {inner};
+                g.group = group;
+                return add(g);
+            }
+            case '[': return parse_class();
+            case '.': n.set.set(); n.set.reset('\n'); return add(n);
+            case '^': return add(RxNode{RxNode::BOL});
+            case '$': return add(RxNode{RxNode::EOL});
+            case '*': case '+': case '?': return fail("nothing to repeat");
+            case '\\': {
+                if (!more()) return fail("trailing \\");
+                if (class_escape(s[i], n.set)) { ++i; return add(n); }
+                int b = byte_escape();
+                if (b < 0) return fail("unsupported escape");
+                n.set.set(b);
+                return add(n);
+            }
+        }
+        n.set.set((unsigned char)c);
+        return add(n);
+    }
+};
+
+// Literal that every match of node `k` contains. `exact` is set when the node always matches
+// exactly that text, so neighbouring exact parts of a concatenation can be joined.
+static string required_literal(const vector<RxNode>& nodes, int k, bool& exact) {
+    const RxNode& n = nodes[k];
+    exact = false;
+    switch (n.kind) {
+        case RxNode::EMPTY: case RxNode::BOL: case RxNode::EOL:
+            exact = true;
+            return "";
+        case RxNode::SET:
+            if (n.set.count() != 1) return "";
+            exact = true;
+            for (int c = 0; c < 256; ++c) if (n.set.test(c)) return string(1, (char)c);
+            return "";
+        case RxNode::GROUP:
+            return required_literal(nodes, n.kids[0], exact);
+        case RxNode::REPEAT: {
+            if (n.min == 0) return "";
+            bool childExact;
+            string lit = required_literal(nodes, n.kids[0], childExact);
+            if (!childExact) return lit;
+            exact = n.min == n.max;
+            string out;
+            for (int r = 0; r < n.min; ++r) out += lit;
+            return out;
+        }
+        case RxNode::ALT: {
+            bool e0;
+            string first = required_literal(nodes, n.kids[0], e0);
+            for (size_t j = 1; j < n.kids.size(); ++j) {
+                bool e;
+                if (required_literal(nodes, n.kids[j], e) != first || !e) return "";
+            }
+            exact = e0;
+            return e0 ? first : "";
+        }
+        case RxNode::CAT: {
+            string best, run;
+            bool all = true;
+            for (int kid : n.kids) {
+                bool e;
+                string lit = required_literal(nodes, kid, e);
+                if (e) {
+                    run += lit;
+                } else {
+                    all = false;
+                    if (run.size() > best.size()) best = run;
+                    run.clear();
+                    if (lit.size() > best.size()) best = lit;
+                }
+            }
+            if (all) { exact = true; return run; }
+            return run.size() > best.size() ? run : best;
+        }
+    }
+    return "";
+}
+
+// Whether node `k` can match the empty string
+static bool can_be_empty(const vector<RxNode>& nodes, int k) {
+    const RxNode& n = nodes[k];
+    switch (n.kind) {
+        case RxNode::EMPTY: case RxNode::BOL: case RxNode::EOL: return true;
+        case RxNode::SET: return false;
+        case RxNode::GROUP: return can_be_empty(nodes, n.kids[0]);
+        case RxNode::REPEAT: return n.min == 0 || can_be_empty(nodes, n.kids[0]);
+        case RxNode::ALT:
+            for (int kid : n.kids) if (can_be_empty(nodes, kid)) return true;
+            return false;
+        case RxNode::CAT:
+            for (int kid : n.kids) if (!can_be_empty(nodes, kid)) return false;
+            return true;
+    }
+    return false;
+}
+
+// ---- Compilation (Thompson construction; SPLIT's first target has priority) ----
+
+struct RxCompiler {
+    const vector<RxNode>& nodes;
+    vector<Regex::Inst>& prog;
+    vector<bitset<256>>& classes;
+    int groups;
+    int& slots; // capture slots, then one per level of nested loops that can match empty text
+    int loopDepth = 0; // such loops around the code being generated
+    bool tooBig = false;
+    bool emptyOnly = false; // generating a copy that may only match the empty string
+
+    int emit(Regex::Inst in) {
+        if (prog.size() >= MAX_PROGRAM) tooBig = true;
+        if (tooBig) return (int)prog.size();
+        prog.push_back(in);
+        return (int)prog.size() - 1;
+    }
+
+    void gen(int k) {
+        if (tooBig) return;
+        const RxNode& n = nodes[k];
+        switch (n.kind) {
+            case RxNode::EMPTY: break;
+            case RxNode::SET: {
+                bitset<256> set = emptyOnly ? bitset<256>() : n.set; // an empty class never matches
+                auto it = find(classes.begin(), classes.end(), set);
+                int cls = (int)(it - classes.begin());
+                if (it == classes.end()) classes.push_back(set);
+                emit({Regex::CHAR, cls, 0});
+                break;
+            }
+            case RxNode::BOL: emit({Regex::BOL, 0, 0}); break;
+            case RxNode::EOL: emit({Regex::EOL, 0, 0}); break;
+            case RxNode::CAT: for (int kid : n.kids) gen(kid); break;
+            case RxNode::GROUP:
+                if (n.group >= 0) emit({Regex::SAVE, 2 * n.group, 0});
+                gen(n.kids[0]);
+                if (n.group >= 0) emit({Regex::SAVE, 2 * n.group + 1, 0});
+                break;
+            case RxNode::ALT: {
+                vector<int> jumps;
+                for (size_t j = 0; j + 1 < n.kids.size(); ++j) {
+                    int split = emit({Regex::SPLIT, 0, 0});
+                    patch(split, (int)prog.size(), true);
+                    gen(n.kids[j]);
+                    jumps.push_back(emit({Regex::JMP, 0, 0}));
+                    patch(split, (int)prog.size(), false);
+                }
+                gen(n.kids.back());
+                for (int j : jumps) patch(j, (int)prog.size(), true);
+                break;
+            }
+            case RxNode::REPEAT: {
+                for (int r = 0; r < n.min; ++r) gen(n.kids[0]);
+                if (n.max < 0 && emptyOnly) {
+                    // Matching nothing, a loop stops after one iteration
+                    int split = emit({Regex::SPLIT, 0, 0});
+                    gen(n.kids[0]);
+                    branch(split, split + 1, (int)prog.size(), n.greedy);
+                } else if (n.max < 0) {
+                    // L: split body, out; body; jmp L
+                    bool nullable = can_be_empty(nodes, n.kids[0]);
+                    int split = emit({Regex::SPLIT, 0, 0});
+                    int progress = -1;
+                    if (nullable) {
+                        // An iteration that consumed nothing leaves the loop right there, at
+                        // its own priority, as in a backtracking engine; looping back would
+                        // only find L already visited at this position. Loops at the same depth
+                        // never run inside one another, so they share a slot.
+                        int slot = 2 * (groups + 1) + loopDepth++;
+                        slots = max(slots, slot + 1);
+                        emit({Regex::SAVE, slot, 0});
+                        gen(n.kids[0]);
+                        progress = emit({Regex::PROGRESS, slot, 0});
+                        loopDepth--;
+                    } else {
+                        gen(n.kids[0]);
+                    }
+                    emit({Regex::JMP, split, 0});
+                    branch(split, split + 1, (int)prog.size(), n.greedy);
+                    if (n.greedy && nullable) {
+                        // A backtracking engine ends a greedy loop with one more iteration that
+                        // matches empty text, and its captures stick. Here that iteration would
+                        // revisit instructions this position has already seen, so it gets a copy
+                        // of the body that can only match empty text, tried before leaving.
+                        int last = emit({Regex::SPLIT, 0, 0});
+                        emptyOnly = true;
+                        gen(n.kids[0]);
+                        emptyOnly = false;
+                        branch(last, last + 1, (int)prog.size(), true);
+                    }
+                    if (progress >= 0) patch(progress, (int)prog.size(), false);
+                } else {
+                    // Nested optionals: (x(x(x)?)?)? for the copies beyond the minimum
+                    vector<int> splits;
+                    for (int r = n.min; r < n.max; ++r) {
+                        splits.push_back(emit({Regex::SPLIT, 0, 0}));
+                        gen(n.kids[0]);
+                    }
+                    for (int sp : splits) branch(sp, sp + 1, (int)prog.size(), n.greedy);
+                }
+                break;
+            }
+        }
+    }
+
+    void patch(int at, int target, bool first) {
+        if (tooBig) return;
+        (first ? prog[at].x : prog[at].y) = target;
+    }
+
+    // Point a SPLIT at `body` and `out`, preferring the body when greedy
+    void branch(int at, int body, int out, bool greedy) {
+        if (tooBig) return;
+        prog[at].x = greedy ? body : out;
+        prog[at].y = greedy ? out : body;
+    }
+};
+
+/**
+ * Parse and compile `pattern`. Check ok() before use: an invalid pattern matches nothing.
+ *
+ * @param pattern The regular expression
+ */
+Regex::Regex(const string& pattern) {
+    RxParser p(pattern);
+    int root = p.more() ? p.parse_alt() : p.add(RxNode{RxNode::EMPTY});
+    if (root >= 0 && p.more()) root = p.fail("unmatched )");
+    if (root < 0) {
+        never_match(p.error);
+        return;
+    }
+    groups_ = p.groups;
+    bool exact;
+    required_ = required_literal(p.nodes, root, exact);
+
+    slots_ = 2 * (groups_ + 1);
+    RxCompiler c{p.nodes, prog_, classes_, groups_, slots_};
+    c.emit({SAVE, 0, 0});
+    c.gen(root);
+    c.emit({SAVE, 1, 0});
+    c.emit({MATCH, 0, 0});
+    if (c.tooBig || prog_.size() * slots_ > MAX_THREAD_SLOTS) never_match("pattern too large");
+    find_first_bytes();
+}
+
+/**
+ * Work out which bytes can begin a match, so searches can skip ahead to the next of them.
+ * Patterns that can match the empty string can begin anywhere.
+ */
+void Regex::find_first_bytes() {
+    first_.reset();
+    anyStart_ = false;
+    vector<char> seen(prog_.size(), 0);
+    vector<int> todo{0};
+    while (!todo.empty()) {
+        int pc = todo.back();
+        todo.pop_back();
+        if (seen[pc]) continue;
+        seen[pc] = 1;
+        const Inst& in = prog_[pc];
+        switch (in.op) {
+            case CHAR: first_ |= classes_[in.x]; break;
+            case SPLIT: todo.push_back(in.x); todo.push_back(in.y); break;
+            case JMP: todo.push_back(in.x); break;
+            case SAVE: case BOL: todo.push_back(pc + 1); break;
+            case PROGRESS: todo.push_back(pc + 1); todo.push_back(in.y); break;
+            case EOL: case MATCH: anyStart_ = true; break;
+        }
+    }
+    firstByte_ = -1;
+    if (first_.count() == 1) {
+        for (int c = 0; c < 256; ++c) if (first_.test(c)) firstByte_ = c;
+    }
+}
+
+/**
+ * Replace the program with one that matches nothing, recording why.
+ *
+ * @param why The error message
+ */
+void Regex::never_match(const string& why) {
+    error_ = why;
+    groups_ = 0;
+    slots_ = 2;
+    required_.clear();
+    classes_.assign(1, bitset<256>());
+    prog_ = {{CHAR, 0, 0}, {MATCH, 0, 0}};
+    first_.reset();
+    anyStart_ = false;
+    firstByte_ = -1;
+}
+
+/**
+ * Expand capture references in a replacement string.
+ *
+ * @param repl The replacement text ($0-$9 or ${n} insert a group, $$ a dollar sign)
+ * @param line The line the match was found in
+ * @param caps The capture offsets from RegexMatcher::search
+ * @return The replacement with references substituted (unset groups become empty)
+ */
+string Regex::expand(const string& repl, const char* line, const vector<int>& caps) const {
+    string out;
+    for (size_t i = 0; i < repl.size(); ++i) {
+        if (repl[i] != '$' || i + 1 >= repl.size()) { out.push_back(repl[i]); continue; }
+        char c = repl[i + 1];
+        int g = -1;
+        size_t next = i + 1;
+        if (c == '$') { out.push_back('$'); i++; continue; }
+        if (isdigit((unsigned char)c)) { g = c - '0'; next = i + 2; }
+        else if (c == '{') {
+            size_t close = repl.find('}', i + 2);
+            if (close != string::npos && close > i + 2 && close - i - 2 <= 4 &&
+                all_of(repl.begin() + i + 2, repl.begin() + close, [](char d) { return isdigit((unsigned char)d); })) {
+                g = stoi(repl.substr(i + 2, close - i - 2));
+                next = close + 1;
+            }
+        }
+        if (g < 0 || g > groups_) { out.push_back('$'); continue; }
+        if (caps[2 * g] >= 0 && caps[2 * g + 1] >= 0) out.append(line + caps[2 * g], (size_t)(caps[2 * g + 1] - caps[2 * g]));
+        i = next - 1;
+    }
+    return out;
+}
+
+// ---- Matching ----
+
+RegexMatcher::RegexMatcher(const Regex& re) : re_(re), slots_(re.slots_) {
+    size_t n = re.prog_.size();
+    for (Threads* t : {&clist_, &nlist_}) {
+        t->dense.resize(n);
+        t->sparse.resize(n);
+        t->caps.resize(n * slots_);
+    }
+    threadCaps_.resize(slots_);
+    mark_.assign(n, 0);
+}
+
+/**
+ * Add the thread at `pc` (and everything reachable from it without consuming a byte) to
+ * `list`, in priority order. Uses an explicit stack; a frame with pc < 0 restores a capture
+ * slot once the branch that set it has been explored.
+ */
+void RegexMatcher::add_thread(Threads& list, int pc0, size_t pos, size_t len, int* caps) {
+    const vector<Regex::Inst>& prog = re_.prog_;
+    stack_.clear();
+    stack_.push_back(Frame{pc0, 0, 0});
+    while (!stack_.empty()) {
+        Frame f = stack_.back();
+        stack_.pop_back();
+        if (f.pc < 0) {
+            caps[f.slot] = f.value;
+            continue;
+        }
+        int pc = f.pc;
+        while (true) {
+            int si = list.sparse[pc];
+            if ((size_t)si < list.size && list.dense[si] == pc) break; // already on the list
+            list.sparse[pc] = (int)list.size;
+            list.dense[list.size++] = pc;
+            const Regex::Inst& in = prog[pc];
+            if (in.op == Regex::JMP) { pc = in.x; continue; }
+            if (in.op == Regex::SPLIT) { stack_.push_back(Frame{in.y, 0, 0}); pc = in.x; continue; }
+            if (in.op == Regex::SAVE) {
+                stack_.push_back(Frame{-1, in.x, caps[in.x]});
+                caps[in.x] = (int)pos;
+                pc++;
+                continue;
+            }
+            if (in.op == Regex::BOL) { if (pos != 0) break; pc++; continue; }
+            if (in.op == Regex::EOL) { if (pos != len) break; pc++; continue; }
+            if (in.op == Regex::PROGRESS) { pc = caps[in.x] == (int)pos ? in.y : pc + 1; continue; }
+            copy(caps, caps + slots_, list.caps.begin() + (size_t)pc * slots_); // CHAR or MATCH
+            break;
+        }
+    }
+}
+
+/**
+ * Pike VM: run every possible thread in lockstep, so each byte is looked at once per program
+ * instruction at most. Threads are kept in priority order, which gives leftmost-first results
+ * (the same match a backtracking engine would report) without any backtracking.
+ *
+ * @param line The line to search
+ * @param len Length of the line
+ * @param from Offset to start searching at
+ * @param caps Receives the match and group offsets
+ * @return True if a match was found
+ */
+bool RegexMatcher::search(const char* line, size_t len, size_t from, vector<int>& caps) {
+    const vector<Regex::Inst>& prog = re_.prog_;
+    bool matched = false;
+    caps.assign(slots_, -1);
+    clist_.size = 0;
+    for (size_t pos = from; ; ++pos) {
+        if (!matched) {
+            if (clist_.size == 0 && !re_.anyStart_) {
+                // No thread alive: skip to the next byte that can begin a match
+                if (re_.firstByte_ >= 0) {
+                    const void* p = pos < len ? memchr(line + pos, re_.firstByte_, len - pos) : nullptr;
+                    pos = p ? (size_t)((const char*)p - line) : len;
+                } else {
+                    while (pos < len && !re_.first_.test((unsigned char)line[pos])) ++pos;
+                }
+                if (pos >= len) break;
+            }
+            fill(threadCaps_.begin(), threadCaps_.end(), -1);
+            add_thread(clist_, 0, pos, len, threadCaps_.data());
+        }
+        if (clist_.size == 0) break;
+        nlist_.size = 0;
+        int c = pos < len ? (unsigned char)line[pos] : -1;
+        for (size_t k = 0; k < clist_.size; ++k) {
+            int pc = clist_.dense[k];
+            const Regex::Inst& in = prog[pc];
+            int* tc = &clist_.caps[(size_t)pc * slots_];
+            if (in.op == Regex::MATCH) {
+                copy(tc, tc + slots_, caps.begin());
+                matched = true;
+                break; // lower-priority threads lose to this match
+            }
+            if (in.op == Regex::CHAR && c >= 0 && re_.classes_[in.x].test(c)) {
+                copy(tc, tc + slots_, threadCaps_.begin());
+                add_thread(nlist_, pc + 1, pos + 1, len, threadCaps_.data());
+            }
+        }
+        swap(clist_, nlist_);
+        if (pos >= len) break;
+    }
+    caps.resize(2 * (re_.groups_ + 1)); // drop the loops' hidden slots
+    return matched;
+}
+
+/**
+ * Instructions reachable from `pc` without consuming a byte, keeping only those that consume
+ * one (CHAR), end the match (MATCH) or wait for the end of the line (EOL, unless `eol`).
+ */
+void RegexMatcher::closure(int pc0, bool bol, bool eol, vector<int>& out) {
+    const vector<Regex::Inst>& prog = re_.prog_;
+    vector<int>& todo = scratch_;
+    todo.clear();
+    todo.push_back(pc0);
+    while (!todo.empty()) {
+        int pc = todo.back();
+        todo.pop_back();
+        if (mark_[pc]) continue;
+        mark_[pc] = 1;
+        const Regex::Inst& in = prog[pc];
+        switch (in.op) {
+            case Regex::JMP: todo.push_back(in.x); break;
+            case Regex::SPLIT: todo.push_back(in.y); todo.push_back(in.x); break;
+            case Regex::SAVE: todo.push_back(pc + 1); break;
+            case Regex::PROGRESS: todo.push_back(in.y); todo.push_back(pc + 1); break;
+            case Regex::BOL: if (bol) todo.push_back(pc + 1); break;
+            case Regex::EOL: if (eol) todo.push_back(pc + 1); else out.push_back(pc); break;
+            default: out.push_back(pc); break;
+        }
+    }
+}
+
+/**
+ * Find or create the DFA state for a set of instructions.
+ *
+ * @param insts The instructions (sorted and deduplicated here)
+ * @return Index of the state
+ */
+int RegexMatcher::dstate(vector<int>& insts) {
+    sort(insts.begin(), insts.end());
+    insts.erase(unique(insts.begin(), insts.end()), insts.end());
+    auto it = lower_bound(dindex_.begin(), dindex_.end(), insts, [](const pair<vector<int>, int>& a, const vector<int>& b) {
+        return a.first < b;
+    });
+    if (it != dindex_.end() && it->first == insts) return it->second;
+    DState st;
+    st.insts = insts;
+    st.match = any_of(insts.begin(), insts.end(), [&](int pc) { return re_.prog_[pc].op == Regex::MATCH; });
+    int id = (int)dstates_.size();
+    dstates_.push_back(move(st));
+    dtrans_.resize(dstates_.size() * 256, -1);
+    dindex_.insert(it, {insts, id});
+    return id;
+}
+
+/**
+ * Follow (and cache) the transition of state `s` on byte `c`. The search is unanchored, so the
+ * start of a new match is added to every successor.
+ */
+int RegexMatcher::dstep(int s, unsigned char c) {
+    int t = dtrans_[(size_t)s * 256 + c];
+    if (t >= 0) return t;
+    if (dstates_.size() >= MAX_DSTATES) {
+        // Cache full: keep only the current state and start over
+        vector<int> keep = dstates_[s].insts;
+        dstates_.clear();
+        dtrans_.clear();
+        dindex_.clear();
+        start_ = -1;
+        s = dstate(keep);
+    }
+    vector<int> next;
+    fill(mark_.begin(), mark_.end(), 0);
+    for (int pc : dstates_[s].insts) {
+        const Regex::Inst& in = re_.prog_[pc];
+        if (in.op == Regex::CHAR && re_.classes_[in.x].test(c)) closure(pc + 1, false, false, next);
+    }
+    closure(0, false, false, next);
+    int id = dstate(next);
+    dtrans_[(size_t)s * 256 + c] = id;
+    return id;
+}
+
+/**
+ * Whether state `s`, reached at the end of a line, completes a match through a trailing $.
+ */
+bool RegexMatcher::dfinal(int s, bool atStart) {
+    if (dstates_[s].match) return true;
+    vector<int> rest;
+    fill(mark_.begin(), mark_.end(), 0);
+    for (int pc : dstates_[s].insts) {
+        if (re_.prog_[pc].op == Regex::EOL) closure(pc + 1, atStart, true, rest);
+    }
+    return any_of(rest.begin(), rest.end(), [&](int pc) { return re_.prog_[pc].op == Regex::MATCH; });
+}
+
+/**
+ * Decide whether the line contains a match, using a DFA built lazily from the program: each
+ * state stands for a set of NFA threads, and transitions are computed the first time they are
+ * taken, so the work per byte is usually a single table lookup.
+ *
+ * @param line The line to test
+ * @param len Length of the line
+ * @return True if the line contains at least one match
+ */
+bool RegexMatcher::contains(const char* line, size_t len) {
+    if (start_ < 0) {
+        vector<int> insts;
+        fill(mark_.begin(), mark_.end(), 0);
+        closure(0, true, false, insts); // at the beginning of a line, so ^ may match
+        start_ = dstate(insts);
+    }
+    int s = start_;
+    for (size_t i = 0; i < len; ++i) {
+        if (dstates_[s].match) return true;
+        s = dstep(s, (unsigned char)line[i]);
+    }
+    return dfinal(s, len == 0);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Regular expression for searching within one line. Supports . [] [^] \d \w \s (and \D \W \S),
+// escapes, ^ and $ (line start/end), groups ( ) and (?: ), alternation |, and the quantifiers
+// * + ? {m} {m,} {m,n}, each with a lazy form ending in ?. There is no backtracking: the pattern
+// compiles once to an NFA program, and matching is linear in the length of the line.
+//
+// Matches and captures are the ones a backtracking engine (PCRE, or std::regex) reports: the
+// leftmost match, preferring earlier alternatives and greedy or lazy counts as written. A
+// repeat whose body matched empty text stops there, and a greedy one reports that last empty
+// iteration's captures: (a*)*b on "dab" gives group 1 = [2,2], and on "b" gives [0,0].
+// One difference remains: a lazy quantifier inside such a repeat may prefer consuming over a
+// new empty iteration, so b([ab]??b*?)*a on "bbaa" matches all of it where PCRE matches "bba".
+class Regex {
+public:
+    explicit Regex(const string& pattern);
+
+    // Whether the pattern compiled; if not, error() says why
+    bool ok() const { return error_.empty(); }
+    const string& error() const { return error_; }
+
+    // Number of capture groups, not counting the whole match ($0)
+    int groups() const { return groups_; }
+
+    // Text that every match contains (possibly empty), for skipping lines that cannot match
+    const string& required() const { return required_; }
+
+    // `repl` with $0-$9, ${n} and $$ replaced from the captures `caps` of a match in `line`
+    string expand(const string& repl, const char* line, const vector<int>& caps) const;
+
+private:
+    friend class RegexMatcher;
+    friend struct RxCompiler;
+
+    enum Op : uint8_t { CHAR, SPLIT, JMP, SAVE, BOL, EOL, MATCH, PROGRESS };
+    struct Inst {
+        Op op;
+        int x; // CHAR: class index; SPLIT/JMP: target (preferred for SPLIT); SAVE/PROGRESS: slot
+        int y; // SPLIT: other target; PROGRESS: where to go if nothing was consumed since slot x
+    };
+
+    vector<Inst> prog_;
+    vector<bitset<256>> classes_;
+    int groups_ = 0;
+    int slots_ = 2; // per thread: the groups' start/end, then where the iteration began for each
+                    // level of nested loops that can match empty text
+    string required_;
+    string error_;
+    bitset<256> first_;    // bytes a match can begin with
+    bool anyStart_ = true; // a match may be empty, so it can begin anywhere
+    int firstByte_ = -1;   // the only byte in first_, if there is just one
+
+    void never_match(const string& why);
+    void find_first_bytes();
+};
+
+// Runs a Regex over lines. Holds the lazily built DFA and the Pike VM's thread lists, so it is
+// cheap to reuse across lines but must not be shared between threads; make one per thread.
+class RegexMatcher {
+public:
+    explicit RegexMatcher(const Regex& re);
+
+    // Whether line[0, len) contains a match anywhere (DFA only, no captures)
+    bool contains(const char* line, size_t len);
+
+    // Leftmost match starting at or after `from` in line[0, len). On success `caps` holds
+    // 2 * (groups() + 1) offsets: start/end of the match, then of each group (-1 if unset).
+    bool search(const char* line, size_t len, size_t from, vector<int>& caps);
+
+private:
+    // Sparse set of program counters, each with its capture slots
+    struct Threads {
+        vector<int> dense;
+        vector<int> sparse;
+        vector<int> caps;
+        size_t size = 0;
+    };
+
+    // DFA state: the NFA instructions it stands for, and transitions filled in on demand
+    struct DState {
+        vector<int> insts;
+        bool match;
+    };
+
+    // add_thread work item: explore `pc`, or (pc < 0) restore caps[slot] = value
+    struct Frame {
+        int pc;
+        int slot;
+        int value;
+    };
+
+    const Regex& re_;
+    int slots_;
+    Threads clist_, nlist_;
+    vector<Frame> stack_;
+    vector<int> threadCaps_;
+    vector<int> scratch_;
+
+    vector<DState> dstates_;
+    vector<int> dtrans_; // dstates_.size() * 256 entries, -1 = not computed yet
+    vector<pair<vector<int>, int>> dindex_; // sorted (insts, state) pairs for lookup
+    vector<char> mark_;
+    int start_ = -1; // DFA state at the beginning of a line
+
+    void add_thread(Threads& list, int pc, size_t pos, size_t len, int* caps);
+    void closure(int pc, bool bol, bool eol, vector<int>& out);
+    int dstate(vector<int>& insts);
+    int dstep(int s, unsigned char c);
+    bool dfinal(int s, bool atStart);
+};
@@ -0,0 +1,221 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "screen.h"
+
+using namespace std;
+
+// Size of the virtual window the script is played into
+static const int REPLAY_WIDTH = 120, REPLAY_HEIGHT = 40;
+
+// One key of the script: the codes term_getch returns for it (224 and a scan code for special
+// keys), the text of a paste, and how the report names it
+struct ReplayKey {
+    vector<int> codes;
+    string paste;
+    string label;
+};
+
+// What one key cost, in seconds
+struct KeyTiming {
+    double latency; // from handing the key over to the end of the first frame after it
+    double render;  // spent on frames until the next key was asked for
+    double busy;    // from handing the key over until the next key was asked for
+};
+
+static bool active = false;
+static vector<ReplayKey> script;
+static vector<KeyTiming> timings;
+static size_t nextKey = 0;  // script[nextKey] is handed over next
+static size_t nextCode = 0; // codes of script[nextKey - 1] already handed over
+static bool inKey = false;  // a key is being handled
+static bool framePending = false; // no frame was drawn for it yet
+static chrono::steady_clock::time_point keyTime;
+static double keyLatency = 0;
+static double renderAtKey = 0;
+
+/**
+ * Parse a keystroke script (see replay.h for the format).
+ *
+ * @param text The script
+ * @param keys Receives the keys
+ * @param error Receives a message if the script is invalid
+ * @return True if the script parsed
+ */
+static bool parse_script(const string& text, vector<ReplayKey>& keys, string& error) {
+    static const map<string, vector<int>> named = {
+        {"Enter", {13}}, {"Tab", {9}}, {"Esc", {27}}, {"BS", {8}}, {"lt", {'<'}},
+        {"Up", {224, 72}}, {"Down", {224, 80}}, {"Left", {224, 75}}, {"Right", {224, 77}},
+        {"Home", {224, 71}}, {"End", {224, 79}}, {"PgUp", {224, 73}}, {"PgDn", {224, 81}}, {"Del", {224, 83}},
+    };
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == '#' && (i == 0 || text[i - 1] == '\n')) { // comment line
+            size_t end = text.find('\n', i);
+            i = end == string::npos ? text.size() : end + 1;
+            continue;
+        }
+        if (c == '\n' || c == '\r') { i++; continue; }
+        if (c != '<') {
+            keys.push_back(ReplayKey{{(unsigned char)c}, "", string(1, c)});
+            i++;
+            continue;
+        }
+        size_t close = text.find('>', i);
+        if (close == string::npos) { error = "unterminated <...> at byte " + to_string(i); return false; }
+        string name = text.substr(i + 1, close - i - 1);
+        i = close + 1;
+        auto it = named.find(name);
+        if (it != named.end()) {
+            keys.push_back(ReplayKey{it->second, "", "<" + name + ">"});
+        } else if (name.size() == 3 && name[0] == 'C' && name[1] == '-' && isalpha((unsigned char)name[2])) {
+            keys.push_back(ReplayKey{{tolower((unsigned char)name[2]) - 'a' + 1}, "", "<" + name + ">"});
+        } else if (name == "paste") {
+            size_t end = text.find("</paste>", i);
+            if (end == string::npos) { error = "<paste> without </paste>"; return false; }
+            string body = text.substr(i, end - i);
+            body.erase(remove(body.begin(), body.end(), '\r'), body.end());
+            keys.push_back(ReplayKey{{TERM_PASTE}, body, "<paste " + to_string(body.size()) + " bytes>"});
+            i = end + 8;
+        } else if (name.rfind("paste-file:", 0) == 0) {
+            string path = name.substr(11);
+            ifstream f(path, ios::binary);
+            if (!f) { error = "cannot read " + path; return false; }
+            stringstream ss;
+            ss << f.rdbuf();
+            string body = ss.str();
+            body.erase(remove(body.begin(), body.end(), '\r'), body.end());
+            keys.push_back(ReplayKey{{TERM_PASTE}, body, "<paste " + path + ">"});
+        } else {
+            error = "unknown key <" + name + ">";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Record the timing of the key being handled, now that the editor asks for the next one.
+ *
+ * @param now When the next key was asked for
+ */
+static void finish_key(chrono::steady_clock::time_point now) {
+    if (!inKey) return;
+    inKey = false;
+    double busy = chrono::duration<double>(now - keyTime).count();
+    timings.push_back(KeyTiming{framePending ? busy : keyLatency, screen_frame_seconds() - renderAtKey, busy});
+}
+
+/**
+ * Hand the editor its next key code. After the script, ESC is returned until the editor quits.
+ *
+ * @param paste Receives the text of a paste
+ * @return The key code
+ */
+static int next_key(string& paste) {
+    // The scan code after a 224 belongs to the same key
+    if (nextKey > 0 && nextCode < script[nextKey - 1].codes.size()) return script[nextKey - 1].codes[nextCode++];
+    finish_key(chrono::steady_clock::now());
+    if (nextKey == script.size()) return 27;
+    const ReplayKey& k = script[nextKey++];
+    nextCode = 1;
+    if (k.codes[0] == TERM_PASTE) paste = k.paste;
+    inKey = true;
+    framePending = true;
+    renderAtKey = screen_frame_seconds();
+    keyTime = chrono::steady_clock::now();
+    return k.codes[0];
+}
+
+/**
+ * Note the first frame drawn for the current key.
+ */
+static void frame_presented() {
+    if (!inKey || !framePending) return;
+    keyLatency = chrono::duration<double>(chrono::steady_clock::now() - keyTime).count();
+    framePending = false;
+}
+
+/**
+ * Read a keystroke script and switch the terminal to headless mode to replay it.
+ *
+ * @param path The script file
+ * @param error Receives a message on failure
+ * @return True if replay is set up
+ */
+bool replay_start(const string& path, string& error) {
+    ifstream f(path, ios::binary);
+    if (!f) { error = "cannot read " + path; return false; }
+    stringstream ss;
+    ss << f.rdbuf();
+    if (!parse_script(ss.str(), script, error)) { error = path + ": " + error; return false; }
+    term_headless(next_key, frame_presented, REPLAY_WIDTH, REPLAY_HEIGHT);
+    active = true;
+    return true;
+}
+
+bool replay_active() {
+    return active;
+}
+
+/**
+ * Percentile of some timings
+ *
+ * @param v The values, in any order
+ * @param p The fraction (0.5 for the median)
+ * @return The value below which a fraction `p` of them lie
+ */
+static double percentile(vector<double> v, double p) {
+    if (v.empty()) return 0;
+    sort(v.begin(), v.end());
+    return v[min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+/**
+ * Write the latency report: for each measure the mean, p50, p90, p99 and maximum in
+ * milliseconds, then the slowest keys.
+ *
+ * @param out Where to write it
+ */
+void replay_report(ostream& out) {
+    finish_key(chrono::steady_clock::now());
+    double total = 0;
+    for (const KeyTiming& t : timings) total += t.busy;
+    out << fixed << setprecision(3);
+    out << "Replayed " << timings.size() << " keys in " << total << " s, " << screen_frame_count() << " frames\n";
+    out << "ms            mean       p50       p90       p99       max\n";
+    auto row = [&](const char* name, double KeyTiming::*field) {
+        vector<double> v;
+        for (const KeyTiming& t : timings) v.push_back(t.*field * 1e3);
+        double sum = 0;
+        for (double x : v) sum += x;
+        out << left << setw(8) << name << right
+            << setw(10) << (v.empty() ? 0 : sum / v.size()) << setw(10) << percentile(v, 0.5)
+            << setw(10) << percentile(v, 0.9) << setw(10) << percentile(v, 0.99)
+            << setw(10) << (v.empty() ? 0 : *max_element(v.begin(), v.end())) << "\n";
+    };
+    row("latency", &KeyTiming::latency);
+    row("render", &KeyTiming::render);
+    row("busy", &KeyTiming::busy);
+
+    vector<size_t> order(timings.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    size_t shown = min<size_t>(5, order.size());
+    partial_sort(order.begin(), order.begin() + shown, order.end(),
+                 [](size_t a, size_t b) { return timings[a].latency > timings[b].latency; });
+    if (shown > 0) out << "Slowest keys:\n";
+    for (size_t i = 0; i < shown; ++i) {
+        const KeyTiming& t = timings[order[i]];
+        out << "  #" << left << setw(7) << order[i] + 1 << setw(24) << script[order[i]].label << right
+            << t.latency * 1e3 << " ms (render " << t.render * 1e3 << ", busy " << t.busy * 1e3 << ")\n";
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// Headless replay of a keystroke script (-r): the editor runs against a virtual window with keys
+// read from the script, each handed over once the editor is idle, and the time every key takes
+// is recorded.
+//
+// Script format: characters are typed as they are and line breaks are ignored (lines starting
+// with '#' are comments). Other keys are written in angle brackets: <Enter> <Tab> <Esc> <BS>
+// <Del> <Up> <Down> <Left> <Right> <Home> <End> <PgUp> <PgDn> <lt> (for '<') and <C-x> for
+// Ctrl+x. <paste>text</paste> pastes `text` with its line breaks, <paste-file:path> a file.
+
+// Read the script at `path` and put the terminal in headless mode to play it; returns false with
+// a message in `error` if the script cannot be read or parsed
+bool replay_start(const string& path, string& error);
+
+// True once replay_start has succeeded
+bool replay_active();
+
+// Write a latency report (per-key latency, render and busy time percentiles, slowest keys)
+void replay_report(ostream& out);
@@ -0,0 +1,174 @@
+#include "scan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define JOT_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Below this many bytes per thread, spawning threads costs more than it saves
+static const size_t PARALLEL_CHUNK = 16u << 20;
+
+// Sinks receive the kernels' results: `bits(mask, at)` where bit i of `mask` means byte
+// `at + i` is '\n', and `one(off)` for single hits from the scalar tail.
+struct CountSink {
+    size_t count = 0;
+    void bits(unsigned mask, size_t) { count += (size_t)__builtin_popcount(mask); }
+    void one(size_t) { count++; }
+};
+
+struct IndexSink {
+    NewlineIndex& out;
+    void bits(unsigned mask, size_t at) {
+        while (mask) { out.push_back(at + (size_t)__builtin_ctz(mask)); mask &= mask - 1; }
+    }
+    void one(size_t off) { out.push_back(off); }
+};
+
+// Writes one chunk's part of a NewlineIndex in place: the low bits of each offset from `dst`
+// on, and the start of every 4 GB segment that begins in the chunk into `segments`
+struct ArraySink {
+    uint32_t* dst;
+    size_t index;     // index of the newline *dst is for
+    size_t* segments;
+    size_t segment;   // segment of the last newline written (or just before the chunk)
+    void one(size_t off) {
+        while ((off >> 32) > segment) segments[++segment] = index;
+        *dst++ = (uint32_t)off;
+        index++;
+    }
+    void bits(unsigned mask, size_t at) {
+        while (mask) { one(at + (size_t)__builtin_ctz(mask)); mask &= mask - 1; }
+    }
+};
+
+template <class Sink>
+static void scan_scalar(const char* data, size_t n, size_t base, Sink& sink) {
+    const char* p = data;
+    const char* end = data + n;
+    while ((p = (const char*)memchr(p, '\n', end - p)) != nullptr) {
+        sink.one(base + (size_t)(p - data));
+        ++p;
+    }
+}
+
+#ifdef JOT_X86
+template <class Sink>
+__attribute__((target("sse2")))
+static void scan_sse2(const char* data, size_t n, size_t base, Sink& sink) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask) sink.bits(mask, base + i);
+    }
+    scan_scalar(data + i, n - i, base + i, sink);
+}
+
+template <class Sink>
+__attribute__((target("avx2")))
+static void scan_avx2(const char* data, size_t n, size_t base, Sink& sink) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+        unsigned ma = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl));
+        unsigned mb = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl));
+        if ((ma | mb) == 0) continue; // long lines: skip 64 bytes at a time
+        if (ma) sink.bits(ma, base + i);
+        if (mb) sink.bits(mb, base + i + 32);
+    }
+    scan_sse2(data + i, n - i, base + i, sink);
+}
+
+static bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+template <class Sink>
+static void scan(const char* data, size_t n, size_t base, Sink& sink) {
+#ifdef JOT_X86
+    if (has_avx2()) scan_avx2(data, n, base, sink);
+    else scan_sse2(data, n, base, sink);
+#else
+    scan_scalar(data, n, base, sink);
+#endif
+}
+
+/**
+ * Append the offset (plus `base`) of every '\n' in data[0, n) to `out`.
+ *
+ * @param data The bytes to scan
+ * @param n Number of bytes
+ * @param base Added to every offset written
+ * @param out Receives the offsets, in increasing order
+ */
+void index_newlines(const char* data, size_t n, size_t base, NewlineIndex& out) {
+    IndexSink sink{out};
+    scan(data, n, base, sink);
+}
+
+size_t count_newlines(const char* data, size_t n) {
+    CountSink sink;
+    scan(data, n, 0, sink);
+    return sink.count;
+}
+
+/**
+ * Index every '\n' in data[0, n), splitting large inputs across hardware threads. A first
+ * parallel pass counts the newlines in each chunk, so the second pass can write every chunk's
+ * offsets straight into its final place in `out` without intermediate vectors.
+ *
+ * @param data The bytes to scan
+ * @param n Number of bytes
+ * @param out An empty index; receives the offsets
+ */
+void index_newlines_parallel(const char* data, size_t n, NewlineIndex& out) {
+    size_t threads = min((size_t)max(1u, thread::hardware_concurrency()), n / PARALLEL_CHUNK);
+    if (threads <= 1) {
+        index_newlines(data, n, 0, out);
+        return;
+    }
+
+    size_t chunk = (n + threads - 1) / threads;
+    vector<size_t> counts(threads + 1, 0);
+    vector<thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t]() {
+            size_t from = t * chunk;
+            CountSink sink;
+            scan(data + from, min(chunk, n - from), from, sink);
+            counts[t + 1] = sink.count;
+        });
+    }
+    for (thread& th : pool) th.join();
+    pool.clear();
+
+    static const size_t UNSET = (size_t)-1;
+    for (size_t t = 0; t < threads; ++t) counts[t + 1] += counts[t];
+    out.low_.resize(counts[threads]);
+    out.segments_.assign(((n - 1) >> 32) + 1, UNSET);
+    out.segments_[0] = 0;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t]() {
+            size_t from = t * chunk;
+            ArraySink sink{out.low_.data() + counts[t], counts[t], out.segments_.data(), from == 0 ? 0 : (from - 1) >> 32};
+            scan(data + from, min(chunk, n - from), from, sink);
+        });
+    }
+    for (thread& th : pool) th.join();
+    // A segment start is left unset when its chunk has no newline after it: the next newline is
+    // then the first of a later chunk
+    for (size_t s = 1; s < out.segments_.size(); ++s) {
+        if (out.segments_[s] == UNSET) out.segments_[s] = counts[min(threads, (s << 32) / chunk + 1)];
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Offsets of the '\n' bytes in a buffer, in increasing order, in 4 bytes each: the low 32 bits
+// are stored per newline and the rest once per 4 GB segment of the buffer
+class NewlineIndex {
+public:
+    size_t size() const { return low_.size(); }
+    bool empty() const { return low_.empty(); }
+
+    // Offset of newline `i`
+    size_t operator[](size_t i) const {
+        if (segments_.size() <= 1) return low_[i];
+        size_t seg = (size_t)(upper_bound(segments_.begin(), segments_.end(), i) - segments_.begin()) - 1;
+        return (seg << 32) | low_[i];
+    }
+
+    // Index of the first newline at or after offset `off` (size() if there is none)
+    size_t lower_bound(size_t off) const {
+        size_t seg = off >> 32;
+        if (seg >= segments_.size()) return size();
+        size_t lo = segments_[seg], hi = seg + 1 < segments_.size() ? segments_[seg + 1] : size();
+        return (size_t)(std::lower_bound(low_.begin() + lo, low_.begin() + hi, (uint32_t)off) - low_.begin());
+    }
+
+    // Append the offset of a newline after all the others
+    void push_back(size_t off) {
+        while (segments_.size() <= (off >> 32)) segments_.push_back(low_.size());
+        low_.push_back((uint32_t)off);
+    }
+
+private:
+    friend void index_newlines_parallel(const char* data, size_t n, NewlineIndex& out);
+    vector<uint32_t> low_;     // offset of each newline modulo 4 GB
+    vector<size_t> segments_;  // segments_[s]: index of the first newline at or after s * 4 GB
+};
+
+// Append to `out` the offset (plus `base`) of every '\n' in data[0, n). Uses AVX2 or SSE2 when
+// the CPU has them, otherwise a memchr loop.
+void index_newlines(const char* data, size_t n, size_t base, NewlineIndex& out);
+
+// Same as index_newlines(data, n, 0, out) on an empty index, but large inputs are split into
+// chunks that are indexed on several threads
+void index_newlines_parallel(const char* data, size_t n, NewlineIndex& out);
+
+// Number of '\n' bytes in data[0, n)
+size_t count_newlines(const char* data, size_t n);
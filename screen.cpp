@@ -0,0 +1,187 @@
+#include "screen.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+static bool operator==(const Cell& a, const Cell& b) { return a.ch == b.ch && a.attr == b.attr; }
+
+// A cell no frame can contain, so a `front` full of them makes every cell look changed
+static const Cell UNKNOWN = {0, 0xFFFF};
+
+static vector<Cell> back;  // the frame being composed
+static vector<Cell> front; // what the terminal shows
+static vector<CellRun> runs; // changed cells found by screen_flush
+static int width = 0, height = 0;
+static int cursorX = 0, cursorY = 0;
+static chrono::steady_clock::time_point frameStart; // when the frame being composed was begun
+static bool composing = false;                      // screen_begin ran since the last flush
+static size_t frames = 0;
+static double frameSeconds = 0;
+
+/**
+ * Start a new frame: size the back buffer to the terminal window and blank it. If the window
+ * moved or changed size, the whole of the next frame is written.
+ */
+void screen_begin() {
+    frameStart = chrono::steady_clock::now();
+    composing = true;
+    int w, h;
+    if (term_window(w, h) || w != width || h != height) {
+        width = w; height = h;
+        front.assign((size_t)w * h, UNKNOWN);
+    }
+    back.assign((size_t)w * h, Cell{' ', term_default_attr()});
+}
+
+/**
+ * Width of the current frame in cells
+ *
+ * @return The width of the frame, or of the console window before the first frame
+ */
+int screen_width() {
+    if (width == 0) {
+        int w, h;
+        term_window(w, h);
+        return w;
+    }
+    return width;
+}
+
+/**
+ * Height of the current frame in cells
+ *
+ * @return The height of the frame, or of the console window before the first frame
+ */
+int screen_height() {
+    if (height == 0) {
+        int w, h;
+        term_window(w, h);
+        return h;
+    }
+    return height;
+}
+
+/**
+ * Colours of ordinary text
+ *
+ * @return The default attribute for blank cells and plain text
+ */
+Attr screen_default_attr() {
+    return term_default_attr();
+}
+
+/**
+ * Write text into the frame, one cell per byte. Control characters show as spaces so every byte
+ * keeps its own column.
+ *
+ * @param x The column to start at
+ * @param y The row to write on
+ * @param text The text to write; whatever passes the right edge is dropped
+ * @param attr The colours to use, or 0 for the default
+ * @return The column after the text
+ */
+int screen_text(int x, int y, const string& text, Attr attr) {
+    if (attr == 0) attr = term_default_attr();
+    int end = x + (int)text.size();
+    if (y < 0 || y >= height) return end;
+    Cell* row = &back[(size_t)y * width];
+    for (int i = max(0, -x), n = (int)text.size(); i < n && x + i < width; ++i) {
+        unsigned char c = (unsigned char)text[i];
+        row[x + i] = Cell{c < 32 ? ' ' : (char)c, attr};
+    }
+    return end;
+}
+
+/**
+ * Blank the rest of a row.
+ *
+ * @param y The row to blank
+ * @param x The first column to blank
+ */
+void screen_clear_line(int y, int x) {
+    if (y < 0 || y >= height) return;
+    for (int i = max(0, x); i < width; ++i) back[(size_t)y * width + i] = Cell{' ', term_default_attr()};
+}
+
+/**
+ * Change the colours of a run of cells, leaving their characters alone.
+ *
+ * @param x The first column
+ * @param y The row
+ * @param count Number of cells (clipped to the row)
+ * @param attr The new colours
+ */
+void screen_attr(int x, int y, int count, Attr attr) {
+    if (y < 0 || y >= height) return;
+    for (int i = max(0, x); i < min(width, x + count); ++i) back[(size_t)y * width + i].attr = attr;
+}
+
+/**
+ * Set where the cursor goes when the frame is flushed.
+ *
+ * @param x The cursor column
+ * @param y The cursor row
+ */
+void screen_cursor(int x, int y) {
+    cursorX = x;
+    cursorY = y;
+}
+
+/**
+ * Write the frame to the terminal. Each row is compared with what the terminal already shows, and
+ * only the changed part of each row is handed to term_present, which writes it all in one call.
+ * Moving the cursor writes no cells and typing rewrites part of one line.
+ */
+void screen_flush() {
+    if (back.empty()) return;
+    if (!composing) frameStart = chrono::steady_clock::now(); // an update to the last frame
+    composing = false;
+    runs.clear();
+    for (int y = 0; y < height; ++y) {
+        const Cell* b = &back[(size_t)y * width];
+        Cell* f = &front[(size_t)y * width];
+        int first = 0, last = width - 1;
+        while (first < width && b[first] == f[first]) ++first;
+        if (first == width) continue;
+        while (b[last] == f[last]) --last;
+        copy(b + first, b + last + 1, f + first);
+        runs.push_back(CellRun{y, first, last});
+    }
+    term_present(back, width, runs, max(0, min(cursorX, width - 1)), max(0, min(cursorY, height - 1)));
+    auto took = chrono::steady_clock::now() - frameStart;
+    frames++;
+    frameSeconds += chrono::duration<double>(took).count();
+    if (g_profile) {
+        profile_add(STAGE_RENDER, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(took).count());
+        profile_key_shown();
+    }
+}
+
+/**
+ * Number of frames flushed so far
+ *
+ * @return The frame count
+ */
+size_t screen_frame_count() {
+    return frames;
+}
+
+/**
+ * Total time spent on frames so far, from screen_begin to the end of screen_flush
+ *
+ * @return The time in seconds
+ */
+double screen_frame_seconds() {
+    return frameSeconds;
+}
+
+/**
+ * Forget what the terminal shows, so the next flush writes every cell.
+ */
+void screen_invalidate() {
+    front.assign(front.size(), UNKNOWN);
+}
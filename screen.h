@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include "term.h"
+
+using namespace std;
+
+// Back buffer of the terminal window. A frame is composed into it with the calls below, starting
+// with screen_begin(), and screen_flush() then writes the cells that changed since the last flush
+// in a single call. Coordinates are cells relative to the top-left of the window.
+
+// A cell position in the window
+struct ScreenPos {
+    int x, y;
+};
+
+// Start a new frame: size the buffer to the console window and blank it
+void screen_begin();
+
+// Size of the current frame (of the console window if no frame was begun yet)
+int screen_width();
+int screen_height();
+
+// Colours of ordinary text, used for blank cells and plain text
+Attr screen_default_attr();
+
+// Write `text` at (x, y), one cell per byte, clipped to the window; returns the column after it.
+// attr 0 means the default colours.
+int screen_text(int x, int y, const string& text, Attr attr = 0);
+
+// Blank row `y` from column `x` to its end
+void screen_clear_line(int y, int x = 0);
+
+// Set the colours of `count` cells starting at (x, y)
+void screen_attr(int x, int y, int count, Attr attr);
+
+// Where the console cursor goes when the frame is flushed
+void screen_cursor(int x, int y);
+
+// Write the cells that differ from what is on screen in one call, then place the cursor
+void screen_flush();
+
+// Frames flushed so far, and the time spent composing and writing them (from screen_begin to the
+// end of screen_flush), for latency reports
+size_t screen_frame_count();
+double screen_frame_seconds();
+
+// Forget what is on screen (e.g. after it was cleared), so the next flush redraws everything
+void screen_invalidate();
@@ -0,0 +1,137 @@
+#include "search.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define JOT_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Needles at least this long use Boyer-Moore-Horspool; its skips beat a byte filter there
+static const size_t HORSPOOL_MIN = 32;
+
+/**
+ * Prepare a searcher for `needle`.
+ *
+ * @param needle The text to look for
+ */
+Searcher::Searcher(const string& needle) : needle_(needle) {
+    if (needle_.empty()) kernel_ = EMPTY;
+    else if (needle_.size() == 1) kernel_ = BYTE;
+    else if (needle_.size() < HORSPOOL_MIN) kernel_ = FILTER;
+    else {
+        kernel_ = HORSPOOL;
+        size_t m = needle_.size();
+        skip_.assign(256, m);
+        for (size_t i = 0; i + 1 < m; ++i) skip_[(unsigned char)needle_[i]] = m - 1 - i;
+    }
+}
+
+/**
+ * Find the first occurrence of the needle in hay[from, n).
+ *
+ * @param hay The text to search
+ * @param n Length of `hay`
+ * @param from Offset to start searching at
+ * @return Offset of the match, or `n` if there is none
+ */
+size_t Searcher::find(const char* hay, size_t n, size_t from) const {
+    size_t m = needle_.size();
+    if (kernel_ == EMPTY || from >= n || n - from < m) return n;
+    switch (kernel_) {
+        case BYTE: {
+            const void* p = memchr(hay + from, needle_[0], n - from);
+            return p ? (size_t)((const char*)p - hay) : n;
+        }
+        case FILTER: return find_filter(hay, n, from);
+        default: return find_horspool(hay, n, from);
+    }
+}
+
+// Compare the needle's inner bytes (first and last already matched)
+static inline bool inner_equal(const char* at, const string& needle) {
+    return memcmp(at + 1, needle.data() + 1, needle.size() - 2) == 0;
+}
+
+#ifdef JOT_X86
+// Candidates are positions where both the first and the last needle byte match; each 32-byte
+// block yields a bitmask of them and only those are verified with memcmp.
+__attribute__((target("avx2")))
+static size_t filter_avx2(const char* hay, size_t n, size_t from, const string& needle) {
+    size_t m = needle.size();
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = from;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(hay + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (inner_equal(hay + at, needle)) return at;
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("sse2")))
+static size_t filter_sse2(const char* hay, size_t n, size_t from, const string& needle) {
+    size_t m = needle.size();
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = from;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (inner_equal(hay + at, needle)) return at;
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+static bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+size_t Searcher::find_filter(const char* hay, size_t n, size_t from) const {
+    size_t m = needle_.size();
+    size_t i = from;
+#ifdef JOT_X86
+    // The SIMD loops return the offset of a match, or where they stopped for lack of input
+    size_t stop = has_avx2() ? filter_avx2(hay, n, from, needle_) : filter_sse2(hay, n, from, needle_);
+    if (stop + m <= n && memcmp(hay + stop, needle_.data(), m) == 0) return stop;
+    i = stop;
+#endif
+    // Scalar tail (or whole search off x86): jump between occurrences of the first byte
+    char f = needle_[0], l = needle_[m - 1];
+    while (i + m <= n) {
+        const char* p = (const char*)memchr(hay + i, f, n - m + 1 - i);
+        if (!p) break;
+        i = (size_t)(p - hay);
+        if (hay[i + m - 1] == l && inner_equal(hay + i, needle_)) return i;
+        ++i;
+    }
+    return n;
+}
+
+size_t Searcher::find_horspool(const char* hay, size_t n, size_t from) const {
+    size_t m = needle_.size();
+    const char* nd = needle_.data();
+    char last = nd[m - 1];
+    size_t i = from;
+    while (i + m <= n) {
+        char c = hay[i + m - 1];
+        if (c == last && memcmp(hay + i, nd, m - 1) == 0) return i;
+        i += skip_[(unsigned char)c];
+    }
+    return n;
+}
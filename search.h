@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Substring searcher for one needle. The kernel is picked from the needle length: memchr for one
+// byte, a SIMD first/last-byte filter for short needles, and Boyer-Moore-Horspool for long ones.
+class Searcher {
+public:
+    explicit Searcher(const string& needle);
+
+    // Offset of the first occurrence in hay[from, n), or n if there is none
+    size_t find(const char* hay, size_t n, size_t from = 0) const;
+
+    size_t size() const { return needle_.size(); }
+
+private:
+    enum Kernel { EMPTY, BYTE, FILTER, HORSPOOL };
+
+    string needle_;
+    Kernel kernel_;
+    vector<size_t> skip_; // Horspool shift per byte value
+
+    size_t find_filter(const char* hay, size_t n, size_t from) const;
+    size_t find_horspool(const char* hay, size_t n, size_t from) const;
+};
@@ -0,0 +1,655 @@
+#include "term.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <functional>
+
+#ifdef _WIN32
+#include <conio.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Declared in the main translation unit: whether Ctrl+C is an editor key rather than an interrupt
+extern volatile bool g_ignoreCtrlC;
+
+static int shownX = -1, shownY = -1; // where the cursor was last put
+static string pasted;                 // the block behind the last TERM_PASTE
+
+// Headless mode (term_headless): keys come from a function and frames go nowhere
+static bool headless = false;
+static function<int(string&)> headlessKey;
+static function<void()> headlessFrame;
+static int headlessWidth = 0, headlessHeight = 0;
+
+/**
+ * Turn the line breaks of pasted text (\r\n, or \r as Enter sends it) into \n.
+ *
+ * @param text The text to fix up in place
+ */
+static void normalize_newlines(string& text) {
+    size_t out = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\r') {
+            text[out++] = '\n';
+            if (i + 1 < text.size() && text[i + 1] == '\n') ++i;
+        } else {
+            text[out++] = text[i];
+        }
+    }
+    text.resize(out);
+}
+
+#ifdef _WIN32
+
+static SMALL_RECT lastWindow = {-1, -1, -1, -1};
+static vector<CHAR_INFO> frame; // the rectangle being written, as the console takes it
+static WORD defaultAttr = 0;
+static bool haveDefault = false;
+
+/**
+ * Console control handler to manage Ctrl+C behavior.
+ *
+ * @param signal The control signal received
+ * @return TRUE to ignore the signal, FALSE to allow default handling
+ */
+static BOOL WINAPI ConsoleHandler(DWORD signal) {
+    if (signal == CTRL_C_EVENT) {
+        // Ignore default termination so Ctrl+C can be used as editor command
+        if (g_ignoreCtrlC) {
+            return TRUE;
+        } else {
+            return FALSE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Take over the console: install the Ctrl+C handler and make the cursor visible.
+ */
+void term_init() {
+    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_CURSOR_INFO cci;
+    GetConsoleCursorInfo(hOut, &cci);
+    cci.bVisible = TRUE;
+    SetConsoleCursorInfo(hOut, &cci);
+}
+
+/**
+ * Nothing to undo on Windows: _getch reads raw keys without changing the console mode.
+ */
+void term_restore() {}
+
+/**
+ * Size of the console window (not the whole scrollback buffer).
+ *
+ * @param width Receives the width in cells
+ * @param height Receives the height in cells
+ * @return True if the window moved or changed size since the last call
+ */
+bool term_window(int& width, int& height) {
+    if (headless) { width = headlessWidth; height = headlessHeight; return false; }
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    if (hOut == INVALID_HANDLE_VALUE || !GetConsoleScreenBufferInfo(hOut, &csbi)) {
+        width = 80; height = 25;
+        return false;
+    }
+    if (!haveDefault) { defaultAttr = csbi.wAttributes; haveDefault = true; }
+    const SMALL_RECT& w = csbi.srWindow;
+    width = max(1, w.Right - w.Left + 1);
+    height = max(1, w.Bottom - w.Top + 1);
+    bool moved = w.Left != lastWindow.Left || w.Top != lastWindow.Top || w.Right != lastWindow.Right || w.Bottom != lastWindow.Bottom;
+    lastWindow = w;
+    if (moved) shownX = shownY = -1;
+    return moved;
+}
+
+/**
+ * Colours the console had at startup
+ *
+ * @return The attribute for ordinary text
+ */
+Attr term_default_attr() {
+    if (headless) return FG_RED | FG_GREEN | FG_BLUE;
+    if (!haveDefault) { int w, h; term_window(w, h); }
+    return defaultAttr;
+}
+
+/**
+ * Write changed cells of a frame with one WriteConsoleOutput call covering all of them, then
+ * move the cursor if it is somewhere else.
+ *
+ * @param cells The frame, row by row
+ * @param width Width of the frame in cells
+ * @param runs The changed cells
+ * @param cx The cursor column
+ * @param cy The cursor row
+ */
+void term_present(const vector<Cell>& cells, int width, const vector<CellRun>& runs, int cx, int cy) {
+    if (headless) { headlessFrame(); return; }
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == INVALID_HANDLE_VALUE) return;
+    if (!runs.empty()) {
+        int minX = width, maxX = -1;
+        for (const CellRun& r : runs) { minX = min(minX, r.first); maxX = max(maxX, r.last); }
+        int minY = runs.front().y, maxY = runs.back().y;
+        int w = maxX - minX + 1, h = maxY - minY + 1;
+        frame.resize((size_t)w * h);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                const Cell& c = cells[(size_t)(minY + y) * width + minX + x];
+                frame[(size_t)y * w + x].Char.AsciiChar = c.ch;
+                frame[(size_t)y * w + x].Attributes = c.attr;
+            }
+        }
+        SMALL_RECT region = {(SHORT)(lastWindow.Left + minX), (SHORT)(lastWindow.Top + minY), (SHORT)(lastWindow.Left + maxX), (SHORT)(lastWindow.Top + maxY)};
+        WriteConsoleOutputA(hOut, frame.data(), COORD{(SHORT)w, (SHORT)h}, COORD{0, 0}, &region);
+    }
+    if (cx != shownX || cy != shownY) {
+        SetConsoleCursorPosition(hOut, COORD{(SHORT)(lastWindow.Left + cx), (SHORT)(lastWindow.Top + cy)});
+        shownX = cx;
+        shownY = cy;
+    }
+}
+
+/**
+ * Clear the whole console buffer and home the cursor
+ */
+void term_clear() {
+    if (headless) return;
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == INVALID_HANDLE_VALUE) return;
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    if (!GetConsoleScreenBufferInfo(hOut, &csbi)) return;
+    DWORD cells = csbi.dwSize.X * csbi.dwSize.Y;
+    COORD home = {0,0};
+    DWORD written = 0;
+    FillConsoleOutputCharacter(hOut, ' ', cells, home, &written);
+    FillConsoleOutputAttribute(hOut, csbi.wAttributes, cells, home, &written);
+    SetConsoleCursorPosition(hOut, home);
+    shownX = shownY = -1;
+}
+
+/**
+ * Read a key with _getch. A paste arrives as ordinary keys, which term_getch gathers up.
+ *
+ * @return The key code
+ */
+static int read_key() {
+    return _getch();
+}
+
+/**
+ * Wait for a key, checking every millisecond
+ *
+ * @param ms The longest time to wait, 0 to only check, -1 for no limit
+ * @return True if a key is waiting
+ */
+static bool key_waiting(int ms) {
+    for (int waited = 0; !_kbhit(); ++waited) {
+        if (ms >= 0 && waited >= ms) return false;
+        Sleep(1);
+    }
+    return true;
+}
+
+/**
+ * Whether a key is held down, from the asynchronous key state
+ *
+ * @param key The key to check
+ * @return True if it is down
+ */
+bool term_key_down(TermKey key) {
+    if (headless) return false;
+    auto down = [](int vk) { return (GetAsyncKeyState(vk) & 0x8000) != 0; };
+    switch (key) {
+        case KEY_SHIFT: return down(VK_SHIFT);
+        case KEY_CONTROL: return down(VK_CONTROL);
+        case KEY_PLUS: return down(VK_ADD) || down(VK_OEM_PLUS);
+        case KEY_MINUS: return down(VK_SUBTRACT) || down(VK_OEM_MINUS);
+    }
+    return false;
+}
+
+/**
+ * Adjust the console font size by delta (positive to increase, negative to decrease)
+ *
+ * @param delta Points to add to the font height
+ */
+void term_font_size(int delta) {
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == INVALID_HANDLE_VALUE) return;
+
+    // CONSOLE_FONT_INFOEX is supported on modern Windows. Use it to get/set font size.
+    CONSOLE_FONT_INFOEX cfi;
+    ZeroMemory(&cfi, sizeof(cfi));
+    cfi.cbSize = sizeof(cfi);
+    if (!GetCurrentConsoleFontEx(hOut, FALSE, &cfi)) return;
+
+    // Adjust font height (Y). Keep X proportional or leave as-is.
+    SHORT newY = (SHORT)max(4, (int)cfi.dwFontSize.Y + delta);
+    // Optional clamp to reasonable max
+    if (newY > 200) newY = 200;
+
+    cfi.dwFontSize.Y = newY;
+    // Apply new font size
+    SetCurrentConsoleFontEx(hOut, FALSE, &cfi);
+}
+
+#else
+
+static struct termios saved;
+static bool rawMode = false;
+static int inFd = STDIN_FILENO; // the keyboard: /dev/tty when stdin is piped text (jot -)
+static int lastWidth = -1, lastHeight = -1;
+static int pending = -1;  // scan code still to be returned after a 224 prefix
+static string out;        // the frame being written
+
+/**
+ * Write all of `data` to the terminal, retrying short writes.
+ *
+ * @param data The bytes to write
+ * @param len How many
+ */
+static void write_all(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+/**
+ * Put the terminal in raw mode on the alternate screen, with the cursor visible. The original
+ * settings come back at exit.
+ */
+void term_init() {
+    if (!isatty(STDIN_FILENO) && inFd == STDIN_FILENO) {
+        int tty = open("/dev/tty", O_RDWR);
+        if (tty >= 0) inFd = tty;
+    }
+    if (rawMode || tcgetattr(inFd, &saved) != 0) return;
+    struct termios raw = saved;
+    // No echo or line editing; Ctrl+C, Ctrl+S, Ctrl+Z etc. arrive as keys; Enter stays '\r'
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~OPOST;
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(inFd, TCSAFLUSH, &raw) != 0) return;
+    rawMode = true;
+    static bool registered = false;
+    if (!registered) { atexit(term_restore); registered = true; }
+    static const char enter[] = "\x1b[?1049h\x1b[?25h\x1b[?2004h"; // also bracketed paste
+    write_all(enter, sizeof(enter) - 1);
+}
+
+/**
+ * Leave the alternate screen and restore the terminal settings term_init replaced.
+ */
+void term_restore() {
+    if (!rawMode) return;
+    static const char leave[] = "\x1b[?2004l\x1b[0m\x1b[?25h\x1b[?1049l";
+    write_all(leave, sizeof(leave) - 1);
+    tcsetattr(inFd, TCSAFLUSH, &saved);
+    rawMode = false;
+}
+
+/**
+ * Size of the terminal from TIOCGWINSZ (80x24 if it cannot be asked).
+ *
+ * @param width Receives the width in cells
+ * @param height Receives the height in cells
+ * @return True if the size changed since the last call
+ */
+bool term_window(int& width, int& height) {
+    if (headless) { width = headlessWidth; height = headlessHeight; return false; }
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+        width = ws.ws_col;
+        height = ws.ws_row;
+    } else {
+        width = 80;
+        height = 24;
+    }
+    bool moved = width != lastWidth || height != lastHeight;
+    lastWidth = width;
+    lastHeight = height;
+    if (moved) shownX = shownY = -1;
+    return moved;
+}
+
+/**
+ * Colours of ordinary text: light grey on black, which is drawn as the terminal's own default
+ * colours (see append_sgr)
+ *
+ * @return The attribute for ordinary text
+ */
+Attr term_default_attr() {
+    return FG_RED | FG_GREEN | FG_BLUE;
+}
+
+/**
+ * Append the SGR sequence selecting `attr`. Foreground and background that match
+ * term_default_attr() are left at the terminal's defaults.
+ *
+ * @param s The output to append to
+ * @param attr The colours to select
+ */
+static void append_sgr(string& s, Attr attr) {
+    static const int ANSI[8] = {0, 4, 2, 6, 1, 5, 3, 7}; // console colour bits (B=1, G=2, R=4) as ANSI numbers
+    Attr def = term_default_attr();
+    int fg = attr & 0x0F, bg = (attr >> 4) & 0x0F;
+    s += "\x1b[0";
+    if (fg != (def & 0x0F)) { s += ';'; s += to_string((fg & 8 ? 90 : 30) + ANSI[fg & 7]); }
+    if (bg != ((def >> 4) & 0x0F)) { s += ';'; s += to_string((bg & 8 ? 100 : 40) + ANSI[bg & 7]); }
+    s += 'm';
+}
+
+/**
+ * Compose the changed cells into one string of cursor moves, colour changes and text, and send
+ * it with a single write. The cursor is hidden while the cells are drawn.
+ *
+ * @param cells The frame, row by row
+ * @param width Width of the frame in cells
+ * @param runs The changed cells
+ * @param cx The cursor column
+ * @param cy The cursor row
+ */
+void term_present(const vector<Cell>& cells, int width, const vector<CellRun>& runs, int cx, int cy) {
+    if (headless) { headlessFrame(); return; }
+    if (runs.empty() && cx == shownX && cy == shownY) return;
+    out.clear();
+    if (!runs.empty()) {
+        out += "\x1b[?25l";
+        int attr = -1;
+        for (const CellRun& r : runs) {
+            out += "\x1b[" + to_string(r.y + 1) + ";" + to_string(r.first + 1) + "H";
+            const Cell* row = &cells[(size_t)r.y * width];
+            for (int x = r.first; x <= r.last; ++x) {
+                if (row[x].attr != attr) { append_sgr(out, row[x].attr); attr = row[x].attr; }
+                out += row[x].ch;
+            }
+        }
+        out += "\x1b[0m";
+    }
+    out += "\x1b[" + to_string(cy + 1) + ";" + to_string(cx + 1) + "H";
+    if (!runs.empty()) out += "\x1b[?25h";
+    write_all(out.data(), out.size());
+    shownX = cx;
+    shownY = cy;
+}
+
+/**
+ * Clear the terminal and home the cursor
+ */
+void term_clear() {
+    if (headless) return;
+    static const char clear[] = "\x1b[0m\x1b[2J\x1b[H";
+    write_all(clear, sizeof(clear) - 1);
+    shownX = shownY = -1;
+}
+
+/**
+ * Whether keyboard input arrives within `ms` milliseconds
+ *
+ * @param ms How long to wait
+ * @return True if a byte can be read
+ */
+static bool input_ready(int ms) {
+    struct pollfd p = {inFd, POLLIN, 0};
+    return poll(&p, 1, ms) > 0;
+}
+
+/**
+ * Read one byte of input, waiting for it
+ *
+ * @return The byte, or -1 at end of input
+ */
+static int read_byte() {
+    unsigned char c;
+    while (true) {
+        ssize_t n = read(inFd, &c, 1);
+        if (n == 1) return c;
+        if (n < 0 && errno == EINTR) continue;
+        return -1;
+    }
+}
+
+/**
+ * Read the body of a bracketed paste, up to the ESC [ 201 ~ that ends it, into `pasted`.
+ */
+static void read_paste() {
+    static const string END = "\x1b[201~";
+    pasted.clear();
+    while (true) {
+        int c = read_byte();
+        if (c < 0) break;
+        pasted += (char)c;
+        if (c == '~' && pasted.size() >= END.size() && pasted.compare(pasted.size() - END.size(), END.size(), END) == 0) {
+            pasted.resize(pasted.size() - END.size());
+            break;
+        }
+    }
+    normalize_newlines(pasted);
+}
+
+/**
+ * Read a key, translating the terminal's conventions to _getch's: DEL is Backspace (8), and
+ * escape sequences for arrows, Home/End, PgUp/PgDn and Delete become 224 and a scan code.
+ * A lone ESC is told apart from a sequence by whether more bytes follow at once. A bracketed
+ * paste is read whole and comes back as TERM_PASTE.
+ *
+ * @return The key code; ESC (27) once input has ended
+ */
+static int read_key() {
+    if (pending >= 0) { int k = pending; pending = -1; return k; }
+    while (true) {
+        int c = read_byte();
+        if (c < 0) return 27;
+        if (c == 127) return 8;
+        if (c == 3 && !g_ignoreCtrlC) { // Unix mode: Ctrl+C interrupts as usual
+            term_restore();
+            signal(SIGINT, SIG_DFL);
+            raise(SIGINT);
+        }
+        if (c != 27) return c;
+        if (!input_ready(30)) return 27;
+        int intro = read_byte();
+        if (intro != '[' && intro != 'O') continue; // Alt+key: ignored
+        string params;
+        int final = read_byte();
+        while (final >= 0 && (final < 0x40 || final > 0x7E)) { params += (char)final; final = read_byte(); }
+        int scan = -1;
+        switch (final) {
+            case 'A': scan = 72; break; // Up
+            case 'B': scan = 80; break; // Down
+            case 'C': scan = 77; break; // Right
+            case 'D': scan = 75; break; // Left
+            case 'H': scan = 71; break; // Home
+            case 'F': scan = 79; break; // End
+            case '~':
+                if (params == "1" || params == "7") scan = 71;
+                else if (params == "4" || params == "8") scan = 79;
+                else if (params == "3") scan = 83; // Delete
+                else if (params == "5") scan = 73; // PgUp
+                else if (params == "6") scan = 81; // PgDn
+                else if (params == "200") { read_paste(); return TERM_PASTE; }
+                break;
+        }
+        if (scan < 0) continue; // a key the editor has no use for
+        pending = scan;
+        return 224;
+    }
+}
+
+/**
+ * Wait for a key with poll
+ *
+ * @param ms The longest time to wait, 0 to only check, -1 for no limit
+ * @return True if a key is waiting
+ */
+static bool key_waiting(int ms) {
+    return pending >= 0 || input_ready(ms);
+}
+
+/**
+ * A terminal only reports key presses, not which keys are held
+ *
+ * @param key The key to check
+ * @return Always false
+ */
+bool term_key_down(TermKey key) {
+    (void)key;
+    return false;
+}
+
+/**
+ * The font belongs to the terminal emulator; nothing to do
+ *
+ * @param delta Ignored
+ */
+void term_font_size(int delta) {
+    (void)delta;
+}
+
+#endif
+
+// Keys read ahead while looking for the end of a burst, handed out before reading more
+static vector<int> queued;
+
+#ifdef _WIN32
+// Fewer keys than this arriving at once are taken as typing, more as a paste
+static const size_t PASTE_BURST = 16;
+
+/**
+ * Whether a key is text that goes into the buffer as it is: printable, Tab, Enter, or a byte
+ * of a multi-byte character
+ *
+ * @param c The key code
+ * @return True for text keys
+ */
+static bool is_text(int c) {
+    return (c >= 32 && c < 127) || c == '\t' || c == '\r' || (c >= 128 && c < 256 && c != 224);
+}
+#endif
+
+/**
+ * Read a key. Text that was pasted comes back as a single TERM_PASTE. On POSIX terminals the
+ * terminal marks pastes (bracketed paste, see read_key). The console on Windows has no paste
+ * marking, so there more text keys already waiting than anyone types at once are taken as one;
+ * elsewhere that would also catch typed-ahead keys and key repeat over a slow link.
+ *
+ * @return The key code, or TERM_PASTE with the text in term_paste_text()
+ */
+static int get_key() {
+    if (headless) return headlessKey(pasted);
+    if (!queued.empty()) {
+        int k = queued.front();
+        queued.erase(queued.begin());
+        return k;
+    }
+    if (g_profile) key_waiting(-1); // waiting for the key is not part of reading it
+    ProfileTimer timer(STAGE_INPUT);
+    int c = read_key();
+#ifdef _WIN32
+    if (!is_text(c) || !key_waiting(0)) return c;
+    string burst(1, (char)c);
+    while (key_waiting(0)) {
+        int k = read_key();
+        if (!is_text(k)) {
+            queued.push_back(k);
+            if (k == 0 || k == 224) queued.push_back(read_key()); // keep the scan code with it
+            break;
+        }
+        burst += (char)k;
+    }
+    if (burst.size() < PASTE_BURST) {
+        vector<int> typed;
+        for (size_t i = 1; i < burst.size(); ++i) typed.push_back((unsigned char)burst[i]);
+        queued.insert(queued.begin(), typed.begin(), typed.end());
+        return c;
+    }
+    pasted = move(burst);
+    normalize_newlines(pasted);
+    return TERM_PASTE;
+#else
+    return c;
+#endif
+}
+
+/**
+ * Read a key (see get_key). With -p, this is also where a key's latency starts; it ends with the
+ * next frame, or here if the editor asks for another key without drawing one.
+ *
+ * @return The key code, or TERM_PASTE with the text in term_paste_text()
+ */
+int term_getch() {
+    if (g_profile && !term_kbhit()) profile_key_shown();
+    int c = get_key();
+    profile_key_read();
+    return c;
+}
+
+/**
+ * The text of the paste term_getch last returned TERM_PASTE for
+ *
+ * @return The pasted text, lines separated by '\n'
+ */
+const string& term_paste_text() {
+    return pasted;
+}
+
+/**
+ * Whether a key is waiting
+ *
+ * @return True if term_getch would not block
+ */
+bool term_kbhit() {
+    if (headless) return false; // replayed keys arrive only when asked for
+    return !queued.empty() || key_waiting(0);
+}
+
+/**
+ * Wait for a key
+ *
+ * @param ms The longest time to wait
+ * @return True if a key is waiting
+ */
+bool term_wait_key(int ms) {
+    if (headless) return false;
+    return !queued.empty() || key_waiting(ms);
+}
+
+/**
+ * Switch to headless mode: no terminal is touched, keys come from `next` and frames are only
+ * reported to `presented`. Used instead of term_init.
+ *
+ * @param next Returns the next key code, filling its argument with the text of a TERM_PASTE
+ * @param presented Called after each frame is "written"
+ * @param width Width of the virtual window
+ * @param height Height of the virtual window
+ */
+void term_headless(function<int(string& paste)> next, function<void()> presented, int width, int height) {
+    headless = true;
+    headlessKey = move(next);
+    headlessFrame = move(presented);
+    headlessWidth = width;
+    headlessHeight = height;
+}
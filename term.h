@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Terminal access for the editor: raw keyboard input, the window size and writing frames. On
+// Windows this is the console API; elsewhere it is termios and ANSI escape sequences.
+
+// Cell colours in the Windows console layout: foreground in bits 0-3, background in bits 4-7
+typedef uint16_t Attr;
+const Attr FG_BLUE = 0x01, FG_GREEN = 0x02, FG_RED = 0x04, FG_BRIGHT = 0x08;
+const Attr BG_BLUE = 0x10, BG_GREEN = 0x20, BG_RED = 0x40, BG_BRIGHT = 0x80;
+
+// One character cell of the window
+struct Cell {
+    char ch;
+    Attr attr;
+};
+
+// Changed cells [first, last] of row `y` of a frame
+struct CellRun {
+    int y;
+    int first, last;
+};
+
+// Keys whose up/down state can be asked for (see term_key_down)
+enum TermKey { KEY_SHIFT, KEY_CONTROL, KEY_PLUS, KEY_MINUS };
+
+// Switch to raw input (no echo or line editing; Ctrl+C is a key unless g_ignoreCtrlC is off)
+// with a visible cursor. term_restore() undoes it and also runs at exit.
+void term_init();
+void term_restore();
+
+// Size of the window in cells. Returns true if it moved or changed size since the last call,
+// so whatever was drawn before is gone.
+bool term_window(int& width, int& height);
+
+// Colours of ordinary text
+Attr term_default_attr();
+
+// Write the `runs` of `cells` (a frame `width` cells wide) and put the cursor at (cx, cy),
+// with a single write to the terminal
+void term_present(const vector<Cell>& cells, int width, const vector<CellRun>& runs, int cx, int cy);
+
+// Blank the whole terminal and home the cursor
+void term_clear();
+
+// term_getch() result for a block of pasted text, which term_paste_text() then holds
+const int TERM_PASTE = 0x100;
+
+// Read a key without echo, waiting for one. Arrows and other special keys come back as two
+// codes, 0 or 224 and then a scan code (72 Up, 80 Down, 75 Left, 77 Right), as _getch does.
+// Pasted text comes back as TERM_PASTE rather than key by key.
+int term_getch();
+
+// The text behind the last TERM_PASTE, with lines separated by '\n'
+const string& term_paste_text();
+
+// Whether a key is waiting to be read
+bool term_kbhit();
+
+// Wait up to `ms` milliseconds for a key; returns whether one is waiting
+bool term_wait_key(int ms);
+
+// Whether `key` is held down right now (always false where the terminal cannot tell)
+bool term_key_down(TermKey key);
+
+// Change the font size by `delta` points where the terminal allows it
+void term_font_size(int delta);
+
+// Headless mode, used instead of term_init to replay recorded keys (see replay.h): term_getch
+// returns what `next` does (filling `paste` for a TERM_PASTE), no key is ever waiting, frames go
+// to a virtual `width` x `height` window and `presented` runs after each one.
+void term_headless(function<int(string& paste)> next, function<void()> presented, int width, int height);
@@ -0,0 +1,192 @@
+// Checks the regex engine: syntax, anchors, leftmost-first matches, capture groups (including
+// repeats that can match empty text), $n expansion and rejected patterns, then compares match
+// extents and captures with std::regex (ECMAScript) on random patterns. Run through `make test`.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "../regex.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond, what)                                                   \
+    do {                                                                    \
+        if (!(cond)) { cerr << "FAIL " << __LINE__ << ": " << what << "\n"; ++failures; } \
+    } while (0)
+
+// Offsets of the leftmost match of `pattern` in `line` (match, then each group; -1 if unset),
+// or an empty vector if there is none
+static vector<int> find_match(const string& pattern, const string& line, size_t from = 0) {
+    Regex re(pattern);
+    RegexMatcher m(re);
+    vector<int> caps;
+    if (!m.search(line.data(), line.size(), from, caps)) return {};
+    return caps;
+}
+
+static string show(const vector<int>& caps) {
+    if (caps.empty()) return "no match";
+    string s;
+    for (size_t i = 0; i < caps.size(); i += 2) {
+        s += (i ? " " : "") + string("[") + to_string(caps[i]) + "," + to_string(caps[i + 1]) + "]";
+    }
+    return s;
+}
+
+static void expect(const string& pattern, const string& line, const vector<int>& want) {
+    vector<int> got = find_match(pattern, line);
+    CHECK(got == want, "/" << pattern << "/ on \"" << line << "\": got " << show(got) << ", want " << show(want));
+}
+
+// Tiny deterministic generator for the random comparison
+static unsigned seed = 2024;
+static unsigned next_rand(unsigned n) {
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 16) % n;
+}
+
+// A random pattern over a and b with no capturing groups. Groups only get bounded quantifiers:
+// std::regex backtracks, and unbounded repeats nested deeper would take it exponential time.
+static string random_part(int depth) {
+    static const char* atoms[] = {"a", "b", ".", "[ab]", "[^a]", "a", "b"};
+    static const char* quants[] = {"*", "+", "?", "{0,2}", "{1,}", "{2}", "*?", "+?", "??"};
+    static const char* bounded[] = {"?", "{0,2}", "{2}", "??"};
+    string s;
+    int n = 1 + next_rand(3);
+    for (int i = 0; i < n; ++i) {
+        string atom;
+        if (depth > 0 && next_rand(3) == 0) {
+            atom = "(?:" + random_part(depth - 1);
+            if (next_rand(2)) atom += "|" + (next_rand(2) ? random_part(depth - 1) : string());
+            atom += ")";
+            if (next_rand(2)) atom += bounded[next_rand(4)];
+        } else {
+            atom = atoms[next_rand(7)];
+            if (next_rand(2)) atom += quants[next_rand(9)];
+        }
+        s += atom;
+    }
+    return s;
+}
+
+int main() {
+    // Literals, classes, escapes
+    expect("abc", "xxabcxx", {2, 5});
+    expect("a.c", "abc", {0, 3});
+    expect("[0-9]+", "ab123c", {2, 5});
+    expect("[^a-c]", "abcd", {3, 4});
+    expect("\\d\\s\\w", "x1 y", {1, 4});
+    expect("\\.", "a.b", {1, 2});
+    expect("\\x41", "zA", {1, 2});
+    expect("abc", "ab", {});
+
+    // Anchors, and a search that starts past the beginning
+    expect("^a", "ba", {});
+    expect("a$", "ab a", {3, 4});
+    expect("^$", "", {0, 0});
+    CHECK(find_match("^b", "ab", 1).empty(), "^ only matches at the start of the line");
+    CHECK(find_match("b", "abab", 2) == vector<int>({3, 4}), "search starts at `from`");
+
+    // Leftmost-first: the earliest start wins, then the preferred alternative or repeat count
+    expect("a|ab", "ab", {0, 1});
+    expect("ab|a", "ab", {0, 2});
+    expect("a*", "baa", {0, 0});
+    expect("a+?", "aaa", {0, 1});
+    expect("a{2,3}", "aaaa", {0, 3});
+    expect("a{2,3}?", "aaaa", {0, 2});
+    expect("(?:ab)+", "ababa", {0, 4});
+
+    // Capture groups; unset groups report -1
+    expect("(a)(b)?", "a", {0, 1, 0, 1, -1, -1});
+    expect("(a|b)+", "abb", {0, 3, 2, 3});
+    expect("(a+)(a*)", "aaa", {0, 3, 0, 3, 3, 3});
+    expect("(a+?)(a*)", "aaa", {0, 3, 0, 1, 1, 3});
+    expect("((a)b)c", "abc", {0, 3, 0, 2, 0, 1});
+    expect("(?:(a)|b)*c", "abc", {0, 3, 0, 1});
+
+    // A greedy repeat whose body can match empty text ends with one empty iteration, as in
+    // backtracking engines, and that iteration's captures are the ones reported
+    expect("(a*)*b", "dab", {1, 3, 2, 2});
+    expect("(a*)*b", "b", {0, 1, 0, 0});
+    expect("(a*)+b", "b", {0, 1, 0, 0});
+    expect("(a|)*b", "ab", {0, 2, 1, 1});
+    expect("(a?)*", "aa", {0, 2, 2, 2});
+    expect("(a*)*?b", "b", {0, 1, -1, -1}); // lazy: no iteration at all
+    expect("b([ab]??b*?)*a", "bbab", {0, 3, 2, 2});
+
+    // Repeats that can match empty text, nested and copied many times: the bookkeeping for them
+    // must not grow with the program (this once took gigabytes and seconds per search)
+    {
+        auto t0 = chrono::steady_clock::now();
+        expect("(?:(?:(?:a*)*){100}){60}", string(200, 'a') + "b", {0, 200});
+        string deep;
+        for (int i = 0; i < 300; ++i) deep += "(";
+        deep += "a*";
+        for (int i = 0; i < 300; ++i) deep += ")*";
+        Regex re(deep);
+        RegexMatcher m(re);
+        vector<int> caps;
+        string line(200, 'a');
+        CHECK(!re.ok() || m.search(line.data(), line.size(), 0, caps), "deeply nested repeats match or are rejected");
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        CHECK(seconds < 2, "nested empty-matching repeats took " << seconds << " s");
+    }
+
+    // Replacement expansion
+    {
+        Regex re("(\\w+)@(\\w+)");
+        RegexMatcher m(re);
+        vector<int> caps;
+        string line = "mail bob@example now";
+        CHECK(m.search(line.data(), line.size(), 0, caps), "expansion test matches");
+        CHECK(re.expand("$2 at $1", line.data(), caps) == "example at bob", "$n inserts groups");
+        CHECK(re.expand("${1}1 $$ $0", line.data(), caps) == "bob1 $ bob@example", "${n}, $$ and $0");
+        CHECK(re.expand("[$3]", line.data(), caps) == "[$3]", "a group the pattern lacks stays literal");
+    }
+
+    // Rejected patterns match nothing and say why
+    for (const char* bad : {"a(", "a)", "*a", "[a", "a{3,1}", "\\", "a{2000}", "^*"}) {
+        Regex re(bad);
+        CHECK(!re.ok() && !re.error().empty(), "/" << bad << "/ is rejected");
+        CHECK(find_match(bad, "a(a)*a{").empty(), "/" << bad << "/ matches nothing");
+    }
+
+    // Random patterns against std::regex. The one group sits outside any repeat or is repeated
+    // directly, so ECMAScript's reset of captures at each iteration cannot make the two disagree
+    // about it. A repeated group with a lazy quantifier inside can end elsewhere (see regex.h),
+    // so for those only whether there is a match and where it starts are compared.
+    int compared = 0;
+    for (int t = 0; t < 12000; ++t) {
+        string group = random_part(1);
+        string repeat = next_rand(2) ? "" : string(next_rand(2) ? "*" : "+");
+        string pattern = random_part(1) + "(" + group + ")" + repeat + random_part(1);
+        bool startOnly = !repeat.empty() && (group.find("*?") != string::npos || group.find("+?") != string::npos ||
+                                             group.find("??") != string::npos);
+        string line;
+        for (unsigned n = next_rand(9); n > 0; --n) line += "abc"[next_rand(3)];
+        vector<int> got = find_match(pattern, line);
+        cmatch m;
+        bool found = regex_search(line.c_str(), m, std::regex(pattern));
+        vector<int> want;
+        if (found) {
+            for (int g = 0; g < 2; ++g) {
+                want.push_back(m[g].matched ? (int)m.position(g) : -1);
+                want.push_back(m[g].matched ? (int)(m.position(g) + m.length(g)) : -1);
+            }
+        }
+        if (startOnly && !got.empty() && !want.empty()) { got.resize(1); want.resize(1); }
+        CHECK(got == want, "/" << pattern << "/ on \"" << line << "\": got " << show(got) << ", std::regex " << show(want));
+        ++compared;
+        if (failures > 20) break;
+    }
+
+    if (failures) { cerr << failures << " check(s) failed\n"; return 1; }
+    cout << "test_regex: all checks passed (" << compared << " random patterns)\n";
+    return 0;
+}
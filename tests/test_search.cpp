@@ -0,0 +1,119 @@
+// Checks that the parallel, chunked search reports exactly what a serial scan does. Matches are
+// planted on both sides of every 4 MB chunk boundary: adjacent ones, overlapping candidates,
+// and lines that consist of nothing but matches. Run through `make test`.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../util.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond, what)                                                   \
+    do {                                                                    \
+        if (!(cond)) { cerr << "FAIL " << __LINE__ << ": " << what << "\n"; ++failures; } \
+    } while (0)
+
+static const size_t CHUNK = 4u << 20; // SEARCH_CHUNK in util.cpp
+
+// The original find_all: std::string::find line by line, non-overlapping
+static vector<Match> reference(const vector<string>& lines, const string& q) {
+    vector<Match> out;
+    for (int i = 0; i < (int)lines.size(); ++i) {
+        for (size_t pos = 0; (pos = lines[i].find(q, pos)) != string::npos; pos += q.size()) {
+            out.push_back(Match{i, (int)pos, (int)q.size()});
+        }
+    }
+    return out;
+}
+
+static bool same(const vector<Match>& a, const vector<Match>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].line != b[i].line || a[i].start != b[i].start || a[i].len != b[i].len) return false;
+    }
+    return true;
+}
+
+static string join(const vector<string>& lines) {
+    string text;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (i) text += '\n';
+        text += lines[i];
+    }
+    return text;
+}
+
+int main() {
+    // ~20 MB of filler lines that never contain 'a'
+    vector<string> lines;
+    unsigned x = 12345;
+    size_t bytes = 0;
+    while (bytes < (20u << 20)) {
+        x = x * 1103515245u + 12345u;
+        string line(20 + (x >> 16) % 100, 'x');
+        for (size_t i = 0; i < line.size(); i += 7) line[i] = (char)('b' + (x >> (i % 24)) % 20);
+        bytes += line.size() + 1;
+        lines.push_back(line);
+    }
+
+    // Find the lines chunks start at, the same way collect_occurrences cuts them, and plant
+    // matches at the end of the line before and the start of the line after each boundary.
+    // Overwriting keeps every line's length, so the boundaries stay where they are.
+    TextBuffer buf;
+    buf.assign(join(lines));
+    vector<size_t> starts;
+    for (size_t off = CHUNK; off < buf.size(); off += CHUNK) {
+        size_t line = buf.line_at(off) + 1;
+        if (line + 1 >= lines.size()) break; // no chunk starts there (and no room for the planting)
+        starts.push_back(line);
+    }
+    CHECK(starts.size() >= 4, "the buffer spans several chunks");
+    for (size_t first : starts) {
+        string& before = lines[first - 1];
+        string& after = lines[first];
+        before.replace(before.size() - 9, 9, "abaaaaaaa"); // odd run: "aa" leaves one over
+        after.replace(0, 8, "aaaaaaab");
+        lines[first + 1].assign(lines[first + 1].size(), 'a'); // nothing but matches
+    }
+    buf.assign(join(lines));
+    for (size_t i = 0; i < starts.size(); ++i) {
+        CHECK(buf.line_at((i + 1) * CHUNK) + 1 == starts[i], "planting moved chunk boundary " << i);
+    }
+
+    const char* literals[] = {"a", "aa", "aaa", "ab", "ba", "xa", "not there"};
+    for (const char* q : literals) {
+        vector<Match> expect = reference(lines, q);
+        g_searchThreads = 1;
+        vector<Match> serial = find_all(buf, q);
+        g_searchThreads = 4;
+        vector<Match> parallel = find_all(buf, q);
+        CHECK(same(serial, expect), "serial find_all of \"" << q << "\" matches the line-by-line scan");
+        CHECK(same(parallel, expect), "parallel find_all of \"" << q << "\" matches the line-by-line scan");
+        SearchState state;
+        SearchControl ctl;
+        CHECK(same(state.update(buf, q, false, &ctl), expect), "chunked SearchState of \"" << q << "\" matches");
+    }
+
+    // Regular expressions, including ones that match empty text
+    const char* patterns[] = {"a+", "a*b", "(ab)?a", "a*", "b$", "^a"};
+    for (const char* q : patterns) {
+        g_searchThreads = 1;
+        vector<Match> serial = find_all(buf, q, true);
+        g_searchThreads = 4;
+        vector<Match> parallel = find_all(buf, q, true);
+        CHECK(!serial.empty(), "regex \"" << q << "\" finds the planted matches");
+        CHECK(same(serial, parallel), "parallel regex \"" << q << "\" matches the serial scan");
+        SearchState state;
+        SearchControl ctl;
+        CHECK(same(state.update(buf, q, true, &ctl), serial), "chunked SearchState of regex \"" << q << "\" matches");
+    }
+    g_searchThreads = 0;
+
+    if (failures) { cerr << failures << " check(s) failed\n"; return 1; }
+    cout << "test_search: all checks passed\n";
+    return 0;
+}
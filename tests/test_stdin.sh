@@ -0,0 +1,40 @@
+#!/bin/sh
+# Replays keys against text piped into `jot -` while the pipe is still open: Ctrl+S saves what
+# has arrived so far, other edits are refused until Ctrl+E stops reading, and CRLF input is saved
+# with CRLF. The writer sends its last line a second later, after the replay is done with it.
+# Run through `make test`, with the editor binary as the argument.
+
+JOT=$(cd "$(dirname "${1:-./jot}")" && pwd)/$(basename "${1:-./jot}")
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+failures=0
+
+# check <what> <file> <expected contents, printf format>
+check() {
+    printf "$3" > "$DIR/want"
+    if ! cmp -s "$2" "$DIR/want"; then
+        printf '%s\n' "FAIL: $1: got '$(od -An -c "$2" 2>/dev/null | tr -s ' \n' ' ')', want '$(od -An -c "$DIR/want" | tr -s ' \n' ' ')'"
+        failures=$((failures + 1))
+    fi
+}
+
+# replay <keys> <first lines> <line sent later>: the final text goes to $DIR/text
+replay() {
+    printf '%s' "$1" > "$DIR/keys"
+    rm -f "$DIR/out.txt"
+    (printf "$2"; sleep 1; printf "$3") 2>/dev/null | (cd "$DIR" && "$JOT" -r keys - > text 2> report)
+}
+
+replay '<C-s>out.txt<Enter><C-e>x' 'one\ntwo\n' 'three\n'
+check "save while the pipe is open writes what has arrived" "$DIR/out.txt" 'one\ntwo\n'
+check "Ctrl+E stops reading and allows editing" "$DIR/text" 'xone\ntwo'
+
+replay 'y<C-s>out.txt<Enter>' 'one\ntwo\n' 'three\n'
+check "edits wait while stdin is read" "$DIR/text" 'one\ntwo'
+check "the refused edit is not saved" "$DIR/out.txt" 'one\ntwo\n'
+
+replay '<C-s>out.txt<Enter>' 'one\r\ntwo' '\r\n'
+check "a snapshot keeps CRLF and a partial last line" "$DIR/out.txt" 'one\r\ntwo'
+
+if [ $failures -gt 0 ]; then echo "$failures check(s) failed"; exit 1; fi
+echo "test_stdin: all checks passed"
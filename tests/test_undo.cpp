@@ -0,0 +1,64 @@
+// Checks that undo history over the memory budget is spilled to disk and comes back whole, and
+// that a spill that cannot be written keeps the history in memory instead of losing it. Run
+// through `make test`.
+
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+#include "../undo.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond, what)                                                   \
+    do {                                                                    \
+        if (!(cond)) { cerr << "FAIL " << __LINE__ << ": " << what << "\n"; ++failures; } \
+    } while (0)
+
+static const int STEPS = 2000;
+
+// Make STEPS separate undo steps of about 100 bytes each, then undo them all. Returns how many
+// steps came back; the buffer should then be empty again.
+static int edit_and_undo(TextBuffer& buf) {
+    for (int i = 0; i < STEPS; ++i) {
+        string line = "line " + to_string(i) + " " + string(90, 'x') + "\n";
+        insert_text(buf, i, 0, line, i, 0);
+    }
+    int undone = 0, row = 0, col = 0;
+    while (do_undo(buf, row, col)) ++undone;
+    return undone;
+}
+
+int main() {
+    set_undo_budget(64u << 10); // the steps take about four times that
+
+    TextBuffer buf;
+    buf.assign("");
+    CHECK(edit_and_undo(buf) == STEPS, "every step is undone after spilling");
+    CHECK(buf.text().empty(), "undoing everything restores the text");
+
+#ifndef _WIN32
+    // Writes to the spill file now fail (EFBIG instead of SIGXFSZ): nothing may be lost
+    signal(SIGXFSZ, SIG_IGN);
+    rlimit small = {1, 1};
+    rlimit old;
+    getrlimit(RLIMIT_FSIZE, &old);
+    small.rlim_max = old.rlim_max;
+    bool limited = setrlimit(RLIMIT_FSIZE, &small) == 0;
+    int undone = edit_and_undo(buf);
+    setrlimit(RLIMIT_FSIZE, &old); // before reporting, which may write to a file too
+    CHECK(limited, "file size limit set");
+    CHECK(undone == STEPS, "every step is undone when the spill file cannot be written (got " << undone << ")");
+    CHECK(buf.text().empty(), "undoing everything after failed spills restores the text");
+#endif
+
+    if (failures) { cerr << failures << " check(s) failed\n"; return 1; }
+    cout << "test_undo: all checks passed\n";
+    return 0;
+}
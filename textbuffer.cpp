@@ -0,0 +1,475 @@
+#include "textbuffer.h"
+#include "scan.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// Capacity of each block that receives typed/inserted text
+static const size_t ADD_BLOCK_SIZE = 1 << 20;
+
+/**
+ * Construct an empty document (a single empty line).
+ */
+TextBuffer::TextBuffer() {
+#ifdef _WIN32
+    eol_ = "\r\n";
+#else
+    eol_ = "\n";
+#endif
+    assign(string()); // buffer 0 is always the original, even when empty
+}
+
+/**
+ * Replace the whole document with `text`. The string is kept as the original buffer and the
+ * newline index is built once here.
+ *
+ * @param text The new document contents (lines separated by '\n', no trailing newline)
+ */
+void TextBuffer::assign(string text) {
+    auto b = make_shared<Buffer>();
+    b->size = b->cap = text.size();
+    b->owned.reset(new char[text.size() + 1]);
+    memcpy(b->owned.get(), text.data(), text.size());
+    b->data = b->owned.get();
+    string().swap(text);
+    reset(b);
+}
+
+/**
+ * Replace the whole document with memory owned elsewhere (typically a read-only file mapping).
+ * Nothing is copied: only the newline index is built, and edits go to the add buffers.
+ *
+ * @param data The document bytes (lines separated by '\n', no trailing newline)
+ * @param size Number of bytes at `data`
+ * @param owner Keeps `data` valid for as long as the buffer refers to it
+ */
+void TextBuffer::assign_external(const char* data, size_t size, shared_ptr<void> owner) {
+    auto b = make_shared<Buffer>();
+    b->owner = std::move(owner);
+    b->data = data;
+    b->size = b->cap = size;
+    reset(b);
+}
+
+/**
+ * Grow the original buffer by the bytes after its current end, which the caller has written (or
+ * mapped) in place, and append them to the document, extending its last piece when that piece
+ * ends the original buffer.
+ *
+ * @param size The new size of the original buffer
+ * @param more Offsets of the newlines in the new bytes, in increasing order
+ */
+void TextBuffer::extend_original(size_t size, const NewlineIndex& more) {
+    Buffer& b = *buffers_[0];
+    if (size <= b.size) return;
+    for (size_t i = 0; i < more.size(); ++i) b.newlines.push_back(more[i]);
+    size_t start = b.size, len = size - b.size;
+    b.size = b.cap = size;
+    if (!extend_last(root_, 0, len, more.size())) {
+        root_ = merge(root_, new_node(Piece{0, start, len, more.size()}));
+    }
+    version_++;
+}
+
+bool TextBuffer::mapped() const {
+    for (const auto& b : buffers_) {
+        if (b->owner) return true;
+    }
+    return false;
+}
+
+size_t TextBuffer::line_count() const {
+    return (root_ < 0 ? 0 : nodes_[root_].lf) + 1;
+}
+
+size_t TextBuffer::size() const {
+    return root_ < 0 ? 0 : nodes_[root_].size;
+}
+
+/**
+ * Byte offset of the first character of line `i`. Descends the tree by line-feed counts and
+ * binary-searches the buffer's newline index inside the piece that holds the break.
+ *
+ * @param i The line index (clamped to the last line)
+ * @return The byte offset where line `i` starts
+ */
+size_t TextBuffer::line_start(size_t i) const {
+    if (i == 0 || root_ < 0) return 0;
+    if (i >= line_count()) i = line_count() - 1;
+    size_t off = 0;
+    int t = root_;
+    while (t >= 0) {
+        const Node& n = nodes_[t];
+        size_t leftLf = n.left >= 0 ? nodes_[n.left].lf : 0;
+        size_t leftSize = n.left >= 0 ? nodes_[n.left].size : 0;
+        if (i <= leftLf) { t = n.left; continue; }
+        i -= leftLf;
+        off += leftSize;
+        if (i <= n.p.lf) {
+            const NewlineIndex& nl = buffers_[n.p.buf]->newlines;
+            size_t first = nl.lower_bound(n.p.start);
+            return off + (nl[first + i - 1] - n.p.start) + 1;
+        }
+        i -= n.p.lf;
+        off += n.p.len;
+        t = n.right;
+    }
+    return off;
+}
+
+/**
+ * Index of the line holding byte offset `off` (a '\n' belongs to the line it ends).
+ *
+ * @param off The byte offset (clamped to size())
+ * @return The line index
+ */
+size_t TextBuffer::line_at(size_t off) const {
+    size_t line = 0;
+    int t = root_;
+    while (t >= 0) {
+        const Node& n = nodes_[t];
+        size_t leftSize = n.left >= 0 ? nodes_[n.left].size : 0;
+        if (off < leftSize) { t = n.left; continue; }
+        off -= leftSize;
+        line += n.left >= 0 ? nodes_[n.left].lf : 0;
+        if (off < n.p.len) return line + count_lf(n.p.buf, n.p.start, off);
+        off -= n.p.len;
+        line += n.p.lf;
+        t = n.right;
+    }
+    return line;
+}
+
+size_t TextBuffer::line_length(size_t i) const {
+    size_t start = line_start(i);
+    size_t end = (i + 1 < line_count()) ? line_start(i + 1) - 1 : size();
+    return end - start;
+}
+
+string TextBuffer::line(size_t i) const {
+    size_t start = line_start(i);
+    size_t end = (i + 1 < line_count()) ? line_start(i + 1) - 1 : size();
+    return substr(start, end - start);
+}
+
+/**
+ * Insert `text` at (line, col). Columns past the end of the line are clamped.
+ *
+ * @param line The line to insert into
+ * @param col The column to insert at
+ * @param text The text to insert (may contain '\n')
+ */
+void TextBuffer::insert(size_t line, size_t col, const string& text) {
+    if (text.empty()) return;
+    col = min(col, line_length(line));
+    insert_at(line_start(line) + col, text);
+}
+
+/**
+ * Erase `count` bytes starting at (line, col). A line break counts as one byte.
+ *
+ * @param line The line to erase from
+ * @param col The column to start erasing at
+ * @param count Number of bytes to erase
+ */
+void TextBuffer::erase(size_t line, size_t col, size_t count) {
+    col = min(col, line_length(line));
+    size_t off = line_start(line) + col;
+    count = min(count, size() - off);
+    if (count == 0) return;
+    erase_at(off, count);
+}
+
+void TextBuffer::insert_line(size_t i, const string& text) {
+    if (i >= line_count()) {
+        insert_at(size(), "\n" + text);
+    } else {
+        insert_at(line_start(i), text + "\n");
+    }
+}
+
+void TextBuffer::erase_line(size_t i) {
+    size_t n = line_count();
+    if (i >= n) return;
+    size_t start = line_start(i);
+    size_t len = line_length(i);
+    if (n == 1) {
+        erase_at(0, len);
+    } else if (i + 1 < n) {
+        erase_at(start, len + 1);
+    } else {
+        erase_at(start - 1, len + 1); // last line: take the preceding break with it
+    }
+}
+
+const char* TextBuffer::original_data() const {
+    return buffers_[0]->data;
+}
+
+/**
+ * Collect the ranges of the document that no longer match the original buffer byte for byte.
+ * Pieces taken from the original at their original offset are unchanged; everything else
+ * (inserted text, or original text that shifted) is a change. If any original text has shifted
+ * the document's length profile differs from the file and the ranges are not meaningful.
+ *
+ * @param out Receives merged, increasing [start, end) document ranges
+ * @return False if original text appears at a different offset than it had originally
+ */
+bool TextBuffer::changed_ranges(vector<pair<size_t, size_t>>& out) const {
+    out.clear();
+    bool aligned = true;
+    vector<int> stack;
+    size_t off = 0;
+    int t = root_;
+    // In-order walk over the pieces
+    while (t >= 0 || !stack.empty()) {
+        while (t >= 0) { stack.push_back(t); t = nodes_[t].left; }
+        t = stack.back(); stack.pop_back();
+        const Piece& p = nodes_[t].p;
+        if (p.buf == 0) {
+            if (p.start != off) aligned = false;
+        } else if (!out.empty() && out.back().second == off) {
+            out.back().second = off + p.len;
+        } else {
+            out.push_back({off, off + p.len});
+        }
+        off += p.len;
+        t = nodes_[t].right;
+    }
+    return aligned;
+}
+
+string TextBuffer::substr(size_t off, size_t len) const {
+    string out;
+    out.reserve(len);
+    for_each_span(off, len, [&](const char* p, size_t n) { out.append(p, n); });
+    return out;
+}
+
+string TextBuffer::text() const {
+    return substr(0, size());
+}
+
+void TextBuffer::for_each_span(size_t off, size_t len, const function<void(const char*, size_t)>& fn) const {
+    if (off >= size() || len == 0) return;
+    visit(root_, 0, off, min(size(), off + len), [&](const Piece& p) {
+        fn(buffers_[p.buf]->data + p.start, p.len);
+    });
+}
+
+/**
+ * Hand lines [first, last) to `fn` as runs of whole lines that are contiguous in memory. Lines that
+ * lie inside one piece are passed straight from the buffer; only a line that spans pieces is copied.
+ * Line breaks inside a piece are found with the buffer's newline index, so nothing is scanned here.
+ *
+ * @param first The first line to visit
+ * @param last One past the last line to visit (clamped to line_count())
+ * @param fn Called as fn(line, data, len): data holds whole lines joined by '\n' (none trailing)
+ *           and `line` is the index of the first of them
+ */
+void TextBuffer::for_each_line_run(size_t first, size_t last, const function<void(size_t, const char*, size_t)>& fn) const {
+    last = min(last, line_count());
+    if (first >= last) return;
+    size_t from = line_start(first);
+    size_t to = (last < line_count()) ? line_start(last) - 1 : size();
+    size_t line = first;
+    string carry;      // a line that started in an earlier piece
+    bool open = false; // whether `carry` holds an unfinished line
+    if (from == to) { fn(line, "", 0); return; }
+    visit(root_, 0, from, to, [&](const Piece& p) {
+        const char* data = buffers_[p.buf]->data;
+        const NewlineIndex& nl = buffers_[p.buf]->newlines;
+        size_t lo = nl.lower_bound(p.start);
+        size_t hi = nl.lower_bound(p.start + p.len);
+        size_t pos = p.start, end = p.start + p.len;
+        if (lo == hi) { // no break here: the piece is the middle of a line
+            carry.append(data + pos, p.len);
+            open = true;
+            return;
+        }
+        if (open) { // finish the line carried over from earlier pieces
+            carry.append(data + pos, nl[lo] - pos);
+            fn(line++, carry.data(), carry.size());
+            carry.clear();
+            pos = nl[lo] + 1;
+            ++lo;
+        }
+        if (lo != hi) { // whole lines up to the last break in this piece
+            size_t lastNl = nl[hi - 1];
+            fn(line, data + pos, lastNl - pos);
+            line += hi - lo;
+            pos = lastNl + 1;
+        }
+        carry.assign(data + pos, end - pos);
+        open = true;
+    });
+    if (open) fn(line, carry.data(), carry.size());
+}
+
+// ---- Tree internals ----
+
+void TextBuffer::reset(shared_ptr<Buffer> original) {
+    nodes_.clear();
+    free_.clear();
+    buffers_.clear();
+    addBuf_ = -1;
+    root_ = -1;
+    version_++;
+    Buffer& b = *original;
+    index_newlines_parallel(b.data, b.size, b.newlines);
+    buffers_.push_back(original);
+    if (b.size > 0) root_ = new_node(Piece{0, 0, b.size, b.newlines.size()});
+}
+
+size_t TextBuffer::count_lf(uint32_t buf, size_t start, size_t len) const {
+    const NewlineIndex& nl = buffers_[buf]->newlines;
+    return nl.lower_bound(start + len) - nl.lower_bound(start);
+}
+
+int TextBuffer::new_node(const Piece& p) {
+    seed_ ^= seed_ << 13; seed_ ^= seed_ >> 17; seed_ ^= seed_ << 5;
+    Node n{p, seed_, -1, -1, p.len, p.lf};
+    if (!free_.empty()) {
+        int t = free_.back(); free_.pop_back();
+        nodes_[t] = n;
+        return t;
+    }
+    nodes_.push_back(n);
+    return (int)nodes_.size() - 1;
+}
+
+void TextBuffer::free_tree(int t) {
+    if (t < 0) return;
+    free_tree(nodes_[t].left);
+    free_tree(nodes_[t].right);
+    free_.push_back(t);
+}
+
+void TextBuffer::pull(int t) {
+    Node& n = nodes_[t];
+    n.size = n.p.len;
+    n.lf = n.p.lf;
+    if (n.left >= 0) { n.size += nodes_[n.left].size; n.lf += nodes_[n.left].lf; }
+    if (n.right >= 0) { n.size += nodes_[n.right].size; n.lf += nodes_[n.right].lf; }
+}
+
+int TextBuffer::merge(int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (nodes_[a].prio > nodes_[b].prio) {
+        int r = merge(nodes_[a].right, b);
+        nodes_[a].right = r;
+        pull(a);
+        return a;
+    }
+    int l = merge(a, nodes_[b].left);
+    nodes_[b].left = l;
+    pull(b);
+    return b;
+}
+
+/**
+ * Split the subtree `t` so that `l` holds the first `off` bytes and `r` the rest. A piece that
+ * straddles the split point is cut in two.
+ */
+void TextBuffer::split(int t, size_t off, int& l, int& r) {
+    if (t < 0) { l = r = -1; return; }
+    size_t leftSize = nodes_[t].left >= 0 ? nodes_[nodes_[t].left].size : 0;
+    if (off <= leftSize) {
+        int a, b;
+        split(nodes_[t].left, off, a, b);
+        nodes_[t].left = b;
+        pull(t);
+        l = a; r = t;
+        return;
+    }
+    size_t within = off - leftSize;
+    if (within < nodes_[t].p.len) {
+        // Cut this piece: keep the head in `t`, move the tail into a new node on the right
+        Piece head = nodes_[t].p;
+        Piece tail{head.buf, head.start + within, head.len - within, 0};
+        head.len = within;
+        head.lf = count_lf(head.buf, head.start, head.len);
+        tail.lf = nodes_[t].p.lf - head.lf;
+        int tn = new_node(tail);
+        nodes_[tn].right = nodes_[t].right;
+        pull(tn);
+        nodes_[t].p = head;
+        nodes_[t].right = -1;
+        pull(t);
+        l = t; r = tn;
+        return;
+    }
+    int a, b;
+    split(nodes_[t].right, within - nodes_[t].p.len, a, b);
+    nodes_[t].right = a;
+    pull(t);
+    l = t; r = b;
+}
+
+// Grow the last piece of subtree `t` by `len` bytes if it ends where buffer `buf` ends.
+bool TextBuffer::extend_last(int t, int buf, size_t len, size_t lf) {
+    if (t < 0) return false;
+    Node& n = nodes_[t];
+    if (n.right >= 0) {
+        if (!extend_last(n.right, buf, len, lf)) return false;
+    } else {
+        if ((int)n.p.buf != buf) return false;
+        if (n.p.start + n.p.len + len != buffers_[buf]->size) return false;
+        n.p.len += len;
+        n.p.lf += lf;
+    }
+    pull(t);
+    return true;
+}
+
+void TextBuffer::insert_at(size_t off, const string& text) {
+    // Append to the current add block, starting a new one when it is full
+    if (addBuf_ < 0 || buffers_[addBuf_]->size + text.size() > buffers_[addBuf_]->cap) {
+        auto b = make_shared<Buffer>();
+        b->cap = max(ADD_BLOCK_SIZE, text.size());
+        b->owned.reset(new char[b->cap]);
+        b->data = b->owned.get();
+        buffers_.push_back(b);
+        addBuf_ = (int)buffers_.size() - 1;
+    }
+    Buffer& ab = *buffers_[addBuf_];
+    size_t start = ab.size;
+    memcpy(ab.owned.get() + start, text.data(), text.size());
+    size_t before = ab.newlines.size();
+    index_newlines(text.data(), text.size(), start, ab.newlines);
+    size_t lf = ab.newlines.size() - before;
+    ab.size += text.size();
+
+    int l, r;
+    split(root_, off, l, r);
+    if (!extend_last(l, addBuf_, text.size(), lf)) {
+        l = merge(l, new_node(Piece{(uint32_t)addBuf_, start, text.size(), lf}));
+    }
+    root_ = merge(l, r);
+    version_++;
+}
+
+void TextBuffer::erase_at(size_t off, size_t len) {
+    int l, mid, r;
+    split(root_, off, l, r);
+    split(r, len, mid, r);
+    free_tree(mid);
+    root_ = merge(l, r);
+    version_++;
+}
+
+// Call `fn` with each piece of subtree `t` (clipped to [off, end)), in document order
+void TextBuffer::visit(int t, size_t base, size_t off, size_t end, const function<void(const Piece&)>& fn) const {
+    if (t < 0) return;
+    const Node& n = nodes_[t];
+    size_t leftSize = n.left >= 0 ? nodes_[n.left].size : 0;
+    size_t pieceStart = base + leftSize;
+    size_t pieceEnd = pieceStart + n.p.len;
+    if (off < pieceStart) visit(n.left, base, off, end, fn);
+    size_t a = max(off, pieceStart), b = min(end, pieceEnd);
+    if (a < b) fn(Piece{n.p.buf, n.p.start + (a - pieceStart), b - a, 0});
+    if (end > pieceEnd) visit(n.right, pieceEnd, off, end, fn);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "scan.h"
+
+using namespace std;
+
+// Piece-table text buffer. The document is a sequence of lines joined by '\n'
+// (there is no trailing newline). Text lives in append-only buffers; the
+// document is an ordered list of pieces (slices of those buffers) kept in a
+// balanced tree, so edits and line lookups cost O(log pieces), not O(file).
+class TextBuffer {
+public:
+    TextBuffer();
+
+    // Replace the whole document with `text` (taken over as the original buffer)
+    void assign(string text);
+
+    // Replace the whole document with `size` bytes at `data` without copying them. `owner`
+    // keeps that memory alive (e.g. a file mapping) while any piece or copy refers to it.
+    void assign_external(const char* data, size_t size, shared_ptr<void> owner);
+
+    // Grow the buffer given to assign_external to `size` bytes and add the new bytes to the end of
+    // the document; `more` holds the offsets of their newlines. For progressive loads, which fill
+    // that memory in behind the document. No copy of the buffer may be in use on another thread.
+    void extend_original(size_t size, const NewlineIndex& more);
+
+    // True if the document refers to externally owned memory (see assign_external)
+    bool mapped() const;
+
+    // Number of lines (always at least 1) and total size in bytes
+    size_t line_count() const;
+    size_t size() const;
+
+    // Byte offset of the first character of line `i`, and its length without '\n'
+    size_t line_start(size_t i) const;
+    size_t line_length(size_t i) const;
+
+    // Index of the line holding byte offset `off`
+    size_t line_at(size_t off) const;
+
+    // Copy of line `i` without its '\n'
+    string line(size_t i) const;
+
+    // Insert `text` (may contain '\n') at (line, col)
+    void insert(size_t line, size_t col, const string& text);
+
+    // Erase `count` bytes starting at (line, col); a line break counts as one byte
+    void erase(size_t line, size_t col, size_t count);
+
+    // Insert a new line holding `text` before line `i` (i == line_count() appends)
+    void insert_line(size_t i, const string& text);
+
+    // Remove line `i` entirely; the last remaining line is cleared instead
+    void erase_line(size_t i);
+
+    // Copy `len` bytes starting at byte offset `off`
+    string substr(size_t off, size_t len) const;
+
+    // Copy of the whole document
+    string text() const;
+
+    // Call `fn` on each contiguous run of bytes covering [off, off + len), in order
+    void for_each_span(size_t off, size_t len, const function<void(const char*, size_t)>& fn) const;
+
+    // Call `fn(line, data, len)` on runs of whole lines from [first, last); each run is contiguous
+    // (lines joined by '\n', none trailing) and `line` is the index of its first line
+    void for_each_line_run(size_t first, size_t last, const function<void(size_t, const char*, size_t)>& fn) const;
+
+    // Changes whenever the document does, so derived data (e.g. search results) can tell it is stale
+    uint64_t version() const { return version_; }
+
+    // Line terminator used when the document is written back to disk
+    const string& eol() const { return eol_; }
+    void set_eol(const string& eol) { eol_ = eol; }
+
+    // Whether a line terminator follows the last line on disk
+    bool final_newline() const { return finalNewline_; }
+    void set_final_newline(bool on) { finalNewline_ = on; }
+
+    // Start of the original buffer given to assign/assign_external
+    const char* original_data() const;
+
+    // Byte ranges [first, second) of the document that differ from the original buffer at the
+    // same offsets. Returns false if unchanged text has moved (so offsets no longer line up).
+    bool changed_ranges(vector<pair<size_t, size_t>>& out) const;
+
+private:
+    // Append-only storage. Blocks never reallocate, so bytes stay put once written.
+    struct Buffer {
+        unique_ptr<char[]> owned;
+        shared_ptr<void> owner; // set instead of `owned` for external memory
+        const char* data = nullptr;
+        size_t size = 0;
+        size_t cap = 0;
+        NewlineIndex newlines; // offsets of every '\n' in data[0, size)
+    };
+
+    struct Piece {
+        uint32_t buf;
+        size_t start;
+        size_t len;
+        size_t lf; // number of '\n' inside the piece
+    };
+
+    struct Node {
+        Piece p;
+        uint32_t prio;
+        int left, right;
+        size_t size; // bytes in subtree
+        size_t lf;   // line feeds in subtree
+    };
+
+    vector<shared_ptr<Buffer>> buffers_;
+    int addBuf_ = -1; // index of the block currently receiving inserts
+    vector<Node> nodes_;
+    vector<int> free_;
+    int root_ = -1;
+    uint32_t seed_ = 2463534242u;
+    uint64_t version_ = 0;
+    string eol_;
+    bool finalNewline_ = false;
+
+    void reset(shared_ptr<Buffer> original);
+    size_t count_lf(uint32_t buf, size_t start, size_t len) const;
+    int new_node(const Piece& p);
+    void free_tree(int t);
+    void pull(int t);
+    int merge(int a, int b);
+    void split(int t, size_t off, int& l, int& r);
+    bool extend_last(int t, int buf, size_t len, size_t lf);
+    void insert_at(size_t off, const string& text);
+    void erase_at(size_t off, size_t len);
+    void visit(int t, size_t base, size_t off, size_t end, const function<void(const Piece&)>& fn) const;
+};
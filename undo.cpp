@@ -1,48 +1,472 @@
 #include "undo.h"
+#include "profile.h"
 
-#include <stack>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <vector>
 #include <string>
 
 using namespace std;
 
-struct Snapshot {
-    vector<string> lines;
+// One replacement within a batch: `oldLen` bytes at byte offset `off` became `newLen` bytes
+struct Span {
+    size_t off; // in the document before the batch
+    uint32_t oldLen, newLen;
+};
+
+// One primitive change: `text` was inserted at, or erased from, (line, col). A batch replacement
+// (see replace_text) has `spans` instead, (line, col) is its first span and `text` holds the old
+// then the new text of each span in turn.
+struct Edit {
+    bool insert;
+    int line, col;
+    string text;
+    vector<Span> spans;
+};
+
+// One undo step: the edits it made (in order) and the cursor before them
+struct UndoEntry {
+    vector<Edit> edits;
     int row, col;
 };
 
-static stack<Snapshot> undoStack;
-static const size_t UNDO_LIMIT = 200;
+// A run of the oldest undo steps, compressed and written to the spill file
+struct SpilledBlock {
+    long offset;
+    size_t packedSize;
+    size_t rawSize;
+};
+
+static deque<UndoEntry> undoStack;
+static vector<UndoEntry> redoStack;
+static vector<SpilledBlock> spilled; // oldest first; the file is used as a stack
+static FILE* spillFile = nullptr;
+static long spillEnd = 0;
+static size_t spillRetryAt = 0; // after a failed spill, history size at which to try again
+static size_t undoBytes = 0;   // approximate heap use of undoStack
+static size_t undoBudget = 16u << 20;
+static int groupDepth = 0;
+static bool canCoalesce = false; // the newest step may absorb further typing
+
+static size_t edit_bytes(const Edit& e) {
+    return sizeof(Edit) + e.text.capacity() + e.spans.capacity() * sizeof(Span);
+}
+
+static size_t entry_bytes(const UndoEntry& e) {
+    size_t n = sizeof(UndoEntry);
+    for (const Edit& ed : e.edits) n += edit_bytes(ed);
+    return n;
+}
+
+// ---- Compression (byte-oriented LZ77: literal runs and back-references) ----
+
+static void put_varint(string& out, size_t v) {
+    while (v >= 0x80) { out.push_back((char)(v | 0x80)); v >>= 7; }
+    out.push_back((char)v);
+}
+
+static size_t get_varint(const string& in, size_t& pos) {
+    size_t v = 0;
+    for (int shift = 0; pos < in.size(); shift += 7) {
+        unsigned char b = (unsigned char)in[pos++];
+        v |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return v;
+}
+
+static string compress(const string& in) {
+    static const int HASH_BITS = 16;
+    static const size_t MIN_MATCH = 4;
+    vector<size_t> table(1 << HASH_BITS, (size_t)-1);
+    string out;
+    out.reserve(in.size() / 2 + 16);
+    size_t lit = 0, i = 0;
+    auto flush_literals = [&](size_t end) {
+        // token: (literal length << 1) | 0, followed by the bytes
+        if (end > lit) { put_varint(out, (end - lit) << 1); out.append(in, lit, end - lit); }
+    };
+    while (i + MIN_MATCH <= in.size()) {
+        uint32_t v; memcpy(&v, in.data() + i, 4);
+        uint32_t h = (v * 2654435761u) >> (32 - HASH_BITS);
+        size_t cand = table[h];
+        table[h] = i;
+        if (cand != (size_t)-1 && i - cand < (1u << 24) && memcmp(in.data() + cand, in.data() + i, MIN_MATCH) == 0) {
+            size_t len = MIN_MATCH;
+            while (i + len < in.size() && in[cand + len] == in[i + len]) len++;
+            flush_literals(i);
+            // token: (match length << 1) | 1, followed by the distance
+            put_varint(out, (len << 1) | 1);
+            put_varint(out, i - cand);
+            i += len;
+            lit = i;
+        } else {
+            i++;
+        }
+    }
+    flush_literals(in.size());
+    return out;
+}
+
+static string decompress(const string& in, size_t rawSize) {
+    string out;
+    out.reserve(rawSize);
+    size_t pos = 0;
+    while (pos < in.size()) {
+        size_t tok = get_varint(in, pos);
+        size_t len = tok >> 1;
+        if (tok & 1) {
+            size_t dist = get_varint(in, pos);
+            size_t from = out.size() - dist;
+            for (size_t k = 0; k < len; ++k) out.push_back(out[from + k]); // may overlap
+        } else {
+            out.append(in, pos, len);
+            pos += len;
+        }
+    }
+    return out;
+}
+
+// ---- Spill file ----
+
+static void put_int(string& out, long long v) { out.append((const char*)&v, sizeof(v)); }
+static long long get_int(const string& in, size_t& pos) { long long v; memcpy(&v, in.data() + pos, sizeof(v)); pos += sizeof(v); return v; }
+
+// Move the oldest in-memory steps to disk until the history fits in 3/4 of the budget. Steps
+// leave memory only once they are safely written; if the spill file cannot be created or
+// written, they stay in memory and spilling is tried again after another budget's worth of edits.
+static void spill_oldest() {
+    if (undoBytes < spillRetryAt) return;
+    if (!spillFile) spillFile = tmpfile();
+    size_t target = undoBudget / 4 * 3;
+    string raw;
+    size_t count = 0, bytes = 0;
+    // The newest step always stays in memory (it may still be growing)
+    while (count + 1 < undoStack.size() && undoBytes - bytes > target) {
+        const UndoEntry& e = undoStack[count];
+        bytes += entry_bytes(e);
+        put_int(raw, e.row); put_int(raw, e.col); put_int(raw, (long long)e.edits.size());
+        for (const Edit& ed : e.edits) {
+            put_int(raw, ed.insert); put_int(raw, ed.line); put_int(raw, ed.col);
+            put_int(raw, (long long)ed.text.size());
+            raw += ed.text;
+            put_int(raw, (long long)ed.spans.size());
+            for (const Span& sp : ed.spans) {
+                put_int(raw, (long long)sp.off); put_int(raw, sp.oldLen); put_int(raw, sp.newLen);
+            }
+        }
+        count++;
+    }
+    if (count == 0) return;
+    string packed = compress(raw);
+    bool written = spillFile && fseek(spillFile, spillEnd, SEEK_SET) == 0 &&
+                   fwrite(packed.data(), 1, packed.size(), spillFile) == packed.size() && fflush(spillFile) == 0;
+    if (!written) {
+        spillRetryAt = undoBytes + undoBudget;
+        return;
+    }
+    spillRetryAt = 0;
+    spilled.push_back(SpilledBlock{spillEnd, packed.size(), raw.size()});
+    spillEnd += (long)packed.size();
+    undoStack.erase(undoStack.begin(), undoStack.begin() + count);
+    undoBytes -= bytes;
+}
+
+// Bring the newest spilled block back in front of the in-memory steps
+static bool reload_spilled() {
+    if (spilled.empty() || !spillFile) return false;
+    SpilledBlock blk = spilled.back(); spilled.pop_back();
+    string packed(blk.packedSize, '\0');
+    fseek(spillFile, blk.offset, SEEK_SET);
+    bool ok = fread(&packed[0], 1, packed.size(), spillFile) == packed.size();
+    spillEnd = blk.offset; // the file is a stack: later writes reuse this space
+    if (!ok) { spilled.clear(); spillEnd = 0; return false; }
+    string raw = decompress(packed, blk.rawSize);
+    vector<UndoEntry> entries;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        UndoEntry e;
+        e.row = (int)get_int(raw, pos); e.col = (int)get_int(raw, pos);
+        size_t n = (size_t)get_int(raw, pos);
+        for (size_t k = 0; k < n; ++k) {
+            Edit ed;
+            ed.insert = get_int(raw, pos) != 0;
+            ed.line = (int)get_int(raw, pos); ed.col = (int)get_int(raw, pos);
+            size_t len = (size_t)get_int(raw, pos);
+            ed.text = raw.substr(pos, len); pos += len;
+            size_t spans = (size_t)get_int(raw, pos);
+            ed.spans.resize(spans);
+            for (Span& sp : ed.spans) {
+                sp.off = (size_t)get_int(raw, pos);
+                sp.oldLen = (uint32_t)get_int(raw, pos); sp.newLen = (uint32_t)get_int(raw, pos);
+            }
+            e.edits.push_back(std::move(ed));
+        }
+        entries.push_back(std::move(e));
+    }
+    for (size_t k = entries.size(); k-- > 0; ) {
+        undoBytes += entry_bytes(entries[k]);
+        undoStack.push_front(std::move(entries[k]));
+    }
+    return true;
+}
+
+// ---- History bookkeeping ----
+
+// Cursor position just after `e` has been applied
+static void edit_end(const Edit& e, int& row, int& col) {
+    row = e.line; col = e.col;
+    if (!e.insert) return;
+    for (char ch : e.text) {
+        if (ch == '\n') { row++; col = 0; } else col++;
+    }
+}
+
+// Rewrite the spans of a batch edit from old to new text (forward) or back. Spans are done from
+// the last to the first, so the offsets of those before stay valid, and all spans on one line
+// are rewritten with a single erase and insert.
+static void apply_batch(TextBuffer& buf, const Edit& e, bool forward) {
+    size_t n = e.spans.size();
+    vector<size_t> at(n), textAt(n); // offset in the current document; start of old text in e.text
+    long long shift = 0;
+    size_t t = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const Span& sp = e.spans[i];
+        at[i] = forward ? sp.off : (size_t)((long long)sp.off + shift);
+        textAt[i] = t;
+        t += sp.oldLen + sp.newLen;
+        shift += (long long)sp.newLen - (long long)sp.oldLen;
+    }
+    auto cur_len = [&](size_t i) -> size_t { return forward ? e.spans[i].oldLen : e.spans[i].newLen; };
+    string out;
+    for (size_t last = n; last-- > 0; ) {
+        size_t line = buf.line_at(at[last]);
+        size_t lineStart = buf.line_start(line);
+        size_t first = last;
+        while (first > 0 && at[first - 1] >= lineStart) --first;
+        size_t from = at[first], to = at[last] + cur_len(last);
+        string region = buf.substr(from, to - from);
+        out.clear();
+        size_t done = from;
+        for (size_t i = first; i <= last; ++i) {
+            const Span& sp = e.spans[i];
+            out.append(region, done - from, at[i] - done);
+            if (forward) out.append(e.text, textAt[i] + sp.oldLen, sp.newLen);
+            else out.append(e.text, textAt[i], sp.oldLen);
+            done = at[i] + cur_len(i);
+        }
+        size_t col = from - lineStart;
+        if (to > from) buf.erase(line, col, to - from);
+        if (!out.empty()) buf.insert(line, col, out);
+        last = first;
+    }
+}
+
+static void apply(TextBuffer& buf, const Edit& e, bool forward) {
+    if (!e.spans.empty()) apply_batch(buf, e, forward);
+    else if (e.insert == forward) buf.insert(e.line, e.col, e.text);
+    else buf.erase(e.line, e.col, e.text.size());
+}
+
+// Try to fold a one-character edit into the newest step so a typed word (or a run of
+// backspaces) undoes in one go. A space typed after a word starts a new step.
+static bool coalesce(const Edit& e) {
+    if (!canCoalesce || undoStack.empty() || e.text.size() != 1 || e.text[0] == '\n' || !e.spans.empty()) return false;
+    UndoEntry& top = undoStack.back();
+    if (top.edits.size() != 1) return false;
+    Edit& last = top.edits.back();
+    if (last.insert != e.insert || last.line != e.line || last.text.find('\n') != string::npos) return false;
+    size_t before = edit_bytes(last);
+    if (e.insert) {
+        if (e.col != last.col + (int)last.text.size()) return false;
+        if (e.text[0] != ' ' && last.text.back() == ' ') return false;
+        last.text += e.text;
+    } else {
+        if (e.col + 1 != last.col) return false; // backspace: erases walk leftwards
+        last.text.insert(last.text.begin(), e.text[0]);
+        last.col = e.col;
+    }
+    undoBytes += edit_bytes(last) - before;
+    return true;
+}
+
+static void push_entry(UndoEntry e) {
+    undoBytes += entry_bytes(e);
+    undoStack.push_back(std::move(e));
+    if (undoBytes > undoBudget) spill_oldest();
+}
+
+static void record(Edit e, int row, int col) {
+    ProfileTimer timer(STAGE_UNDO);
+    redoStack.clear();
+    if (groupDepth > 0) {
+        undoStack.back().edits.push_back(std::move(e));
+        undoBytes += edit_bytes(undoStack.back().edits.back());
+        return;
+    }
+    if (coalesce(e)) {
+        if (undoBytes > undoBudget) spill_oldest();
+        return;
+    }
+    UndoEntry entry{{}, row, col};
+    entry.edits.push_back(std::move(e));
+    push_entry(std::move(entry));
+    canCoalesce = true;
+}
+
+static void clamp_cursor(const TextBuffer& buf, int& row, int& col) {
+    if (row < 0) row = 0;
+    if (row >= (int)buf.line_count()) row = (int)buf.line_count() - 1;
+    if (col < 0) col = 0;
+    if (col > (int)buf.line_length(row)) col = (int)buf.line_length(row);
+}
+
+/**
+ * Insert `text` at (line, col) and record the insertion for undo.
+ * 
+ * @param buf The text buffer to edit
+ * @param line The line to insert into
+ * @param col The column to insert at
+ * @param text The text to insert (may contain '\n')
+ * @param curRow The cursor row before the edit
+ * @param curCol The cursor column before the edit
+ */
+void insert_text(TextBuffer& buf, int line, int col, const string& text, int curRow, int curCol) {
+    if (text.empty()) return;
+    {
+        ProfileTimer timer(STAGE_EDIT);
+        buf.insert(line, col, text);
+    }
+    record(Edit{true, line, col, text, {}}, curRow, curCol);
+}
+
+/**
+ * Erase `count` bytes at (line, col) and record the removed text for undo.
+ * 
+ * @param buf The text buffer to edit
+ * @param line The line to erase from
+ * @param col The column to start erasing at
+ * @param count Number of bytes to erase (a line break counts as one)
+ * @param curRow The cursor row before the edit
+ * @param curCol The cursor column before the edit
+ */
+void erase_text(TextBuffer& buf, int line, int col, int count, int curRow, int curCol) {
+    if (count <= 0) return;
+    size_t off = buf.line_start(line) + col;
+    string removed = buf.substr(off, count);
+    if (removed.empty()) return;
+    {
+        ProfileTimer timer(STAGE_EDIT);
+        buf.erase(line, col, removed.size());
+    }
+    record(Edit{false, line, col, removed, {}}, curRow, curCol);
+}
+
+/**
+ * Apply a batch of replacements as one undo step that stores only the replaced and replacing text.
+ * 
+ * @param buf The text buffer to edit
+ * @param reps The replacements, sorted by offset and non-overlapping; offsets refer to the document before any of them
+ * @param curRow The cursor row before the edit
+ * @param curCol The cursor column before the edit
+ */
+void replace_text(TextBuffer& buf, const vector<Replacement>& reps, int curRow, int curCol) {
+    if (reps.empty()) return;
+    Edit e{false, 0, 0, string(), {}};
+    e.spans.reserve(reps.size());
+    size_t bytes = 0;
+    for (const Replacement& r : reps) bytes += r.len + r.text.size();
+    e.text.reserve(bytes);
+    for (const Replacement& r : reps) {
+        e.spans.push_back(Span{r.off, (uint32_t)r.len, (uint32_t)r.text.size()});
+        buf.for_each_span(r.off, r.len, [&](const char* data, size_t len) { e.text.append(data, len); });
+        e.text += r.text;
+    }
+    e.line = (int)buf.line_at(reps[0].off);
+    e.col = (int)(reps[0].off - buf.line_start(e.line));
+    {
+        ProfileTimer timer(STAGE_EDIT);
+        apply_batch(buf, e, true);
+    }
+    record(std::move(e), curRow, curCol);
+    canCoalesce = false;
+}
+
+/**
+ * Start grouping edits into one undo step. Groups may nest; only the outermost counts.
+ * 
+ * @param row The cursor row before the grouped edits
+ * @param col The cursor column before the grouped edits
+ */
+void begin_undo_group(int row, int col) {
+    if (groupDepth++ > 0) return;
+    redoStack.clear();
+    canCoalesce = false;
+    push_entry(UndoEntry{{}, row, col});
+}
 
 /**
- * Push the current state onto the undo stack.
+ * Close the current undo group. An empty group leaves no undo step behind.
+ */
+void end_undo_group() {
+    if (groupDepth == 0 || --groupDepth > 0) return;
+    if (!undoStack.empty() && undoStack.back().edits.empty()) {
+        undoBytes -= entry_bytes(undoStack.back());
+        undoStack.pop_back();
+    } else if (undoBytes > undoBudget) {
+        spill_oldest();
+    }
+}
+
+/**
+ * Set the memory budget for undo history. Older steps beyond it are compressed to a temporary file.
  * 
- * @param lines The current text buffer
- * @param row The current cursor row
- * @param col The current cursor column
+ * @param bytes The budget in bytes
  */
-void push_undo(const vector<string>& lines, int row, int col) {
-    Snapshot s{lines, row, col};
-    undoStack.push(s);
-    while (undoStack.size() > UNDO_LIMIT) undoStack.pop();
+void set_undo_budget(size_t bytes) {
+    undoBudget = bytes;
+    if (undoBytes > undoBudget) spill_oldest();
 }
 
 /**
- * Perform an undo operation, restoring the last snapshot.
+ * Perform an undo operation, reverting the edits of the last step.
  * 
- * @param lines The text buffer to restore
+ * @param buf The text buffer to restore
  * @param row The cursor row to restore
  * @param col The cursor column to restore
  * @return True if an undo was performed, false if there was nothing to undo
  */
-bool do_undo(vector<string>& lines, int& row, int& col) {
-    if (undoStack.empty()) return false;
-    Snapshot s = undoStack.top(); undoStack.pop();
-    lines = s.lines;
-    row = s.row; col = s.col;
-    if (row < 0) row = 0;
-    if (row >= (int)lines.size()) row = (int)lines.size() - 1;
-    if (col < 0) col = 0;
-    if (col > (int)lines[row].size()) col = (int)lines[row].size();
+bool do_undo(TextBuffer& buf, int& row, int& col) {
+    ProfileTimer timer(STAGE_UNDO);
+    if (undoStack.empty() && !reload_spilled()) return false;
+    canCoalesce = false;
+    UndoEntry e = std::move(undoStack.back()); undoStack.pop_back();
+    undoBytes -= entry_bytes(e);
+    for (size_t i = e.edits.size(); i-- > 0; ) apply(buf, e.edits[i], false);
+    row = e.row; col = e.col;
+    clamp_cursor(buf, row, col);
+    redoStack.push_back(std::move(e));
+    return true;
+}
+
+/**
+ * Perform a redo operation, re-applying the last undone step.
+ * 
+ * @param buf The text buffer to edit
+ * @param row The cursor row (set to the end of the re-applied edit)
+ * @param col The cursor column (set to the end of the re-applied edit)
+ * @return True if a redo was performed, false if there was nothing to redo
+ */
+bool do_redo(TextBuffer& buf, int& row, int& col) {
+    ProfileTimer timer(STAGE_UNDO);
+    if (redoStack.empty()) return false;
+    canCoalesce = false;
+    UndoEntry e = std::move(redoStack.back()); redoStack.pop_back();
+    for (const Edit& ed : e.edits) apply(buf, ed, true);
+    if (!e.edits.empty()) edit_end(e.edits.back(), row, col);
+    clamp_cursor(buf, row, col);
+    push_entry(std::move(e));
     return true;
 }
@@ -2,8 +2,31 @@
 
 #include <vector>
 #include <string>
+#include "textbuffer.h"
 
 using namespace std;
 
-void push_undo(const vector<string>& lines, int row, int col);
-bool do_undo(vector<string>& lines, int& row, int& col);
\ No newline at end of file
+// Apply an edit to `buf` and record it in the undo log. (curRow, curCol) is the cursor before the edit.
+void insert_text(TextBuffer& buf, int line, int col, const string& text, int curRow, int curCol);
+void erase_text(TextBuffer& buf, int line, int col, int count, int curRow, int curCol);
+
+// One replacement for replace_text: `len` bytes at byte offset `off` become `text`
+struct Replacement {
+    size_t off;
+    size_t len;
+    string text;
+};
+
+// Apply `reps` (sorted by offset, non-overlapping, offsets into the current document) as a single
+// undo step. Each affected line is rewritten once, and the step stores only the changed text.
+void replace_text(TextBuffer& buf, const vector<Replacement>& reps, int curRow, int curCol);
+
+// Edits made between begin/end are undone and redone as a single step
+void begin_undo_group(int row, int col);
+void end_undo_group();
+
+bool do_undo(TextBuffer& buf, int& row, int& col);
+bool do_redo(TextBuffer& buf, int& row, int& col);
+
+// Memory budget for undo history; older steps beyond it are compressed to a temporary file
+void set_undo_budget(size_t bytes);
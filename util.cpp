@@ -1,30 +1,600 @@
 #include "util.h"
 
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "profile.h"
+#include "regex.h"
+#include "scan.h"
+#include "search.h"
+#include "undo.h"
+
 using namespace std;
 
+size_t g_searchThreads = 0;
+
+// Gaps between hits shorter than this are walked line by line rather than counted in bulk
+static const size_t NEAR_GAP = 1024;
+
+// Each search thread gets at least this much text; smaller buffers are searched on the caller
+static const size_t PARALLEL_SEARCH_MIN = 16u << 20;
+
+// Bytes per unit of work handed out to search threads (rounded to whole lines)
+static const size_t SEARCH_CHUNK = 4u << 20;
+
+// Occurrences filtered between checks for cancellation (a power of two)
+static const size_t FILTER_BATCH = 1u << 16;
+
+// Lines in the first block find_next/find_prev search; each further block is twice as large
+static const size_t FIND_BLOCK = 256;
+
+/**
+ * Report the occurrences of `q` in lines [first, last) of `buf` in document order. Whole runs of lines are searched
+ * straight from the buffer's memory with a length-specialized Searcher; line numbers are only
+ * worked out (by counting line breaks since the previous hit) where a match is found.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find (must not contain '\n')
+ * @param overlapping Whether an occurrence may start inside the previous one
+ * @param first The first line to search
+ * @param last One past the last line to search
+ * @param emit Called as emit(offset, line, start, length) for each occurrence
+ */
+template <class Emit>
+static void scan_occurrences(const TextBuffer& buf, const string& q, bool overlapping, size_t first, size_t last, Emit emit) {
+    Searcher searcher(q);
+    size_t step = overlapping ? 1 : q.size();
+    buf.for_each_line_run(first, last, [&](size_t line, const char* data, size_t len) {
+        size_t base = buf.line_start(line);
+        size_t lineStart = 0; // offset in `data` of the line holding `counted`
+        size_t counted = 0;   // line breaks before this offset are accounted for
+        size_t pos = 0;
+        while ((pos = searcher.find(data, len, pos)) < len) {
+            if (pos - counted < NEAR_GAP) {
+                // Dense hits: step over the few line breaks in between
+                const char* nl;
+                while ((nl = (const char*)memchr(data + counted, '\n', pos - counted))) {
+                    line++;
+                    counted = lineStart = (size_t)(nl - data) + 1;
+                }
+            } else if (size_t breaks = count_newlines(data + counted, pos - counted)) {
+                // Sparse hits: count the gap in bulk, then back up to the line's start
+                line += breaks;
+                lineStart = pos;
+                while (data[lineStart - 1] != '\n') lineStart--;
+            }
+            counted = pos;
+            emit(base + pos, (int)line, (int)(pos - lineStart), (int)q.size());
+            pos += step; // matches never contain '\n', so they never straddle lines
+        }
+    });
+}
+
+/**
+ * Report the matches of `re` in lines [first, last) of `buf` in document order. When every
+ * match must contain some literal text, a Searcher jumps from one line holding it to the next;
+ * each remaining candidate line is checked by the regex's DFA, and only lines that do match run
+ * the slower capture-tracking search to find where.
+ * 
+ * @param buf The text buffer to search
+ * @param re The compiled expression
+ * @param first The first line to search
+ * @param last One past the last line to search
+ * @param emit Called as emit(offset, line, start, length) for each match
+ */
+template <class Emit>
+static void scan_regex(const TextBuffer& buf, const Regex& re, size_t first, size_t last, Emit emit) {
+    RegexMatcher matcher(re);
+    const string& lit = re.required();
+    Searcher searcher(lit);
+    vector<int> caps;
+    buf.for_each_line_run(first, last, [&](size_t line, const char* data, size_t len) {
+        size_t base = buf.line_start(line);
+        size_t pos = 0; // start of the current line within `data`
+        while (true) {
+            if (!lit.empty()) {
+                size_t hit = searcher.find(data, len, pos);
+                if (hit >= len) return;
+                size_t start = hit;
+                while (start > pos && data[start - 1] != '\n') start--;
+                line += count_newlines(data + pos, start - pos);
+                pos = start;
+            }
+            const char* nl = (const char*)memchr(data + pos, '\n', len - pos);
+            size_t end = nl ? (size_t)(nl - data) : len;
+            const char* text = data + pos;
+            size_t n = end - pos;
+            if (matcher.contains(text, n)) {
+                for (size_t from = 0; from <= n && matcher.search(text, n, from, caps);) {
+                    size_t s = (size_t)caps[0], e = (size_t)caps[1];
+                    emit(base + pos + s, (int)line, (int)s, (int)(e - s));
+                    from = e > s ? e : e + 1; // step past empty matches
+                }
+            }
+            if (!nl) return;
+            pos = end + 1;
+            line++;
+        }
+    });
+}
+
+/**
+ * Collect make(offset, line, start, length) for every occurrence of `q` in `buf`, in document order.
+ * Large buffers are cut into line-aligned chunks that a team of threads takes turns claiming
+ * from a shared counter, so threads that finish early keep pulling work; each chunk's results
+ * are kept apart and concatenated in chunk order afterwards, matching a sequential scan.
+ * With a SearchControl, progress is published after every chunk and a cancel request stops the
+ * scan at the next chunk boundary.
+ * 
+ * @param buf The text buffer to search
+ * @param scan Reports the occurrences in a range of lines, as scan(first, last, emit)
+ * @param make Builds the element stored for an occurrence
+ * @param ctl Progress/cancellation shared with another thread, or nullptr
+ * @return The collected elements (empty if cancelled)
+ */
+template <class T, class Scan, class Make>
+static vector<T> collect_occurrences(const TextBuffer& buf, Scan scan, Make make, SearchControl* ctl = nullptr) {
+    vector<T> out;
+    size_t lines = buf.line_count();
+    size_t threads = g_searchThreads ? (buf.size() > SEARCH_CHUNK ? g_searchThreads : 1)
+                                     : min((size_t)max(1u, thread::hardware_concurrency()), buf.size() / PARALLEL_SEARCH_MIN);
+    if (threads <= 1 && !ctl) {
+        scan(0, lines, [&](size_t off, int line, int start, int len) { out.push_back(make(off, line, start, len)); });
+        return out;
+    }
+    threads = max(threads, (size_t)1);
+
+    vector<size_t> bounds{0}; // chunk i covers lines [bounds[i], bounds[i + 1])
+    vector<size_t> offsets{0}; // ... and bytes from offsets[i]
+    for (size_t off = SEARCH_CHUNK; off < buf.size(); off += SEARCH_CHUNK) {
+        size_t line = buf.line_at(off) + 1;
+        if (line >= lines) break;
+        if (line > bounds.back()) {
+            bounds.push_back(line);
+            offsets.push_back(buf.line_start(line));
+        }
+    }
+    bounds.push_back(lines);
+    offsets.push_back(buf.size());
+    size_t chunks = bounds.size() - 1;
+    if (ctl) ctl->total = buf.size();
+
+    vector<vector<T>> parts(chunks);
+    atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < chunks;) {
+            if (ctl && ctl->cancel) return;
+            // Filled locally and moved in once done: neighbouring parts[] headers share cache
+            // lines, and pushing to them from several threads made dense queries slower
+            vector<T> part;
+            size_t matches = 0, end = 0; // non-overlapping count, for progress reports
+            scan(bounds[i], bounds[i + 1], [&](size_t off, int line, int start, int len) {
+                part.push_back(make(off, line, start, len));
+                if (off >= end) { ++matches; end = off + len; }
+            });
+            parts[i] = std::move(part);
+            if (ctl) {
+                ctl->found += matches;
+                ctl->done += offsets[i + 1] - offsets[i];
+            }
+        }
+    };
+    if (threads == 1) {
+        work();
+    } else {
+        vector<thread> pool;
+        for (size_t t = 0; t < threads; ++t) pool.emplace_back(work);
+        for (thread& th : pool) th.join();
+    }
+    if (ctl && ctl->cancel) return out;
+
+    size_t total = 0;
+    for (const vector<T>& part : parts) total += part.size();
+    out.reserve(total);
+    for (const vector<T>& part : parts) out.insert(out.end(), part.begin(), part.end());
+    return out;
+}
+
 /**
- * Find all occurrences (non-overlapping) of `q` in `lines`
+ * Find all occurrences (non-overlapping) of `q` in `buf`.
  * 
- * @param lines The text buffer to search
+ * @param buf The text buffer to search
  * @param q The query string to find
+ * @param regex Whether `q` is a regular expression (see regex.h) rather than literal text
  * @return A vector of Match structures representing all found occurrences
  */
-vector<Match> find_all(const vector<string>& lines, const string& q) {
+vector<Match> find_all(const TextBuffer& buf, const string& q, bool regex) {
+    ProfileTimer timer(STAGE_SEARCH);
+    auto make = [](size_t, int line, int start, int len) { return Match{line, start, len}; };
+    if (q.empty()) return {};
+    if (regex) {
+        Regex re(q);
+        if (!re.ok()) return {};
+        return collect_occurrences<Match>(buf, [&](size_t first, size_t last, auto emit) { scan_regex(buf, re, first, last, emit); }, make);
+    }
+    if (q.find('\n') != string::npos) return {};
+    return collect_occurrences<Match>(buf, [&](size_t first, size_t last, auto emit) { scan_occurrences(buf, q, false, first, last, emit); }, make);
+}
+
+/**
+ * Matches in lines [first, last) only, for a literal query or (with `re`) a regular expression.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string (the pattern `re` was compiled from, if any)
+ * @param re The compiled expression, or nullptr for literal search
+ * @param first The first line to search
+ * @param last One past the last line to search
+ * @return The matches in those lines, as find_all would report them
+ */
+static vector<Match> matches_in(const TextBuffer& buf, const string& q, const Regex* re, size_t first, size_t last) {
     vector<Match> out;
+    auto add = [&](size_t, int line, int start, int len) { out.push_back(Match{line, start, len}); };
     if (q.empty()) return out;
-    for (int i = 0; i < (int)lines.size(); ++i) {
-        const string &ln = lines[i];
-        size_t pos = 0;
-        while (pos < ln.size()) {
-            size_t f = ln.find(q, pos);
-            if (f == string::npos) break;
-            out.push_back(Match{i, (int)f, (int)q.size()});
-            pos = f + (q.empty() ? 1 : q.size());
-        }
+    if (re) {
+        if (re->ok()) scan_regex(buf, *re, first, last, add);
+    } else if (q.find('\n') == string::npos) {
+        scan_occurrences(buf, q, false, first, last, add);
     }
     return out;
 }
 
+/**
+ * Find the occurrences (non-overlapping) of `q` in lines [first, last) of `buf` only.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param first The first line to search
+ * @param last One past the last line to search
+ * @param regex Whether `q` is a regular expression
+ * @return The matches in those lines, as find_all would report them
+ */
+vector<Match> find_in_lines(const TextBuffer& buf, const string& q, size_t first, size_t last, bool regex) {
+    Regex compiled(regex ? q : string());
+    return find_in_lines(buf, q, first, last, regex ? &compiled : nullptr);
+}
+
+/**
+ * Find the occurrences (non-overlapping) of `q` in lines [first, last) of `buf` only.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param first The first line to search
+ * @param last One past the last line to search
+ * @param re `q` compiled as a regular expression, or nullptr to find it as literal text
+ * @return The matches in those lines, as find_all would report them
+ */
+vector<Match> find_in_lines(const TextBuffer& buf, const string& q, size_t first, size_t last, const Regex* re) {
+    ProfileTimer timer(STAGE_SEARCH);
+    return matches_in(buf, q, re, first, last);
+}
+
+/**
+ * Find the first match (as find_all reports them) at or after (line, col), wrapping around to
+ * the top of the buffer. Lines are searched in blocks that double in size, so the cost depends
+ * on the distance to the match rather than on the size of the buffer.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param line The line to start at
+ * @param col Matches on `line` must start at or after this column
+ * @param out Receives the match
+ * @param regex Whether `q` is a regular expression
+ * @return True if the buffer contains a match at all
+ */
+bool find_next(const TextBuffer& buf, const string& q, int line, int col, Match& out, bool regex) {
+    Regex compiled(regex ? q : string());
+    return find_next(buf, q, line, col, out, regex ? &compiled : nullptr);
+}
+
+/**
+ * find_next with the pattern already compiled.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param line The line to start at
+ * @param col Matches on `line` must start at or after this column
+ * @param out Receives the match
+ * @param re `q` compiled as a regular expression, or nullptr to find it as literal text
+ * @return True if the buffer contains a match at all
+ */
+bool find_next(const TextBuffer& buf, const string& q, int line, int col, Match& out, const Regex* re) {
+    ProfileTimer timer(STAGE_SEARCH);
+    size_t lines = buf.line_count();
+    size_t from = (size_t)max(0, min(line, (int)lines - 1));
+    for (const Match& m : matches_in(buf, q, re, from, from + 1)) {
+        if (m.start >= col) { out = m; return true; }
+    }
+    // Everything after `from`, then (wrapping) everything up to and including it
+    for (int pass = 0; pass < 2; ++pass) {
+        size_t at = pass == 0 ? from + 1 : 0;
+        size_t end = pass == 0 ? lines : from + 1;
+        for (size_t block = FIND_BLOCK; at < end; at += block, block *= 2) {
+            vector<Match> found = matches_in(buf, q, re, at, min(end, at + block));
+            if (!found.empty()) { out = found.front(); return true; }
+        }
+    }
+    return false;
+}
+
+/**
+ * Find the last match (as find_all reports them) that starts before (line, col), wrapping
+ * around to the bottom of the buffer. Like find_next, the blocks searched grow with distance.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param line The line to start at
+ * @param col Matches on `line` must start before this column
+ * @param out Receives the match
+ * @param regex Whether `q` is a regular expression
+ * @return True if the buffer contains a match at all
+ */
+bool find_prev(const TextBuffer& buf, const string& q, int line, int col, Match& out, bool regex) {
+    Regex compiled(regex ? q : string());
+    return find_prev(buf, q, line, col, out, regex ? &compiled : nullptr);
+}
+
+/**
+ * find_prev with the pattern already compiled.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param line The line to start at
+ * @param col Matches on `line` must start before this column
+ * @param out Receives the match
+ * @param re `q` compiled as a regular expression, or nullptr to find it as literal text
+ * @return True if the buffer contains a match at all
+ */
+bool find_prev(const TextBuffer& buf, const string& q, int line, int col, Match& out, const Regex* re) {
+    ProfileTimer timer(STAGE_SEARCH);
+    size_t lines = buf.line_count();
+    size_t from = (size_t)max(0, min(line, (int)lines - 1));
+    vector<Match> here = matches_in(buf, q, re, from, from + 1);
+    for (auto it = here.rbegin(); it != here.rend(); ++it) {
+        if (it->start < col) { out = *it; return true; }
+    }
+    // Everything before `from`, then (wrapping) everything from it to the end
+    for (int pass = 0; pass < 2; ++pass) {
+        size_t at = pass == 0 ? from : lines;
+        size_t stop = pass == 0 ? 0 : from;
+        for (size_t block = FIND_BLOCK; at > stop; block *= 2) {
+            size_t begin = at - min(block, at - stop);
+            vector<Match> found = matches_in(buf, q, re, begin, at);
+            if (!found.empty()) { out = found.back(); return true; }
+            at = begin;
+        }
+    }
+    return false;
+}
+
+/**
+ * Replace every match of `q` in one pass over the buffer, recorded as a single undo step.
+ * 
+ * @param buf The text buffer to edit
+ * @param q The query string to find
+ * @param repl The replacement text; for a regex, $0-$9 and ${n} insert capture groups
+ * @param regex Whether `q` is a regular expression
+ * @param curRow The cursor row before the edit
+ * @param curCol The cursor column before the edit
+ * @return The number of replacements made (a regex match whose groups cannot be recovered is skipped)
+ */
+size_t replace_all(TextBuffer& buf, const string& q, const string& repl, bool regex, int curRow, int curCol) {
+    if (q.empty()) return 0;
+    vector<Replacement> reps;
+    if (!regex) {
+        if (q.find('\n') != string::npos) return 0;
+        reps = collect_occurrences<Replacement>(buf, [&](size_t first, size_t last, auto emit) { scan_occurrences(buf, q, false, first, last, emit); },
+                                                [&](size_t off, int, int, int len) { return Replacement{off, (size_t)len, repl}; });
+    } else {
+        Regex re(q);
+        if (!re.ok()) return 0;
+        struct Found {
+            size_t off;
+            int line, start, len;
+        };
+        vector<Found> found = collect_occurrences<Found>(buf, [&](size_t first, size_t last, auto emit) { scan_regex(buf, re, first, last, emit); },
+                                                         [](size_t off, int line, int start, int len) { return Found{off, line, start, len}; });
+        // Run each match again from its start for the capture groups. One that does not come out
+        // the same is left alone: writing the template unexpanded would put "$1" in the text.
+        RegexMatcher matcher(re);
+        vector<int> caps;
+        string text;
+        int textLine = -1;
+        reps.reserve(found.size());
+        for (const Found& f : found) {
+            if (f.line != textLine) { text = buf.line(f.line); textLine = f.line; }
+            if (!matcher.search(text.data(), text.size(), (size_t)f.start, caps) || caps[0] != f.start || caps[1] != f.start + f.len) continue;
+            reps.push_back(Replacement{f.off, (size_t)f.len, re.expand(repl, text.data(), caps)});
+        }
+    }
+    replace_text(buf, reps, curRow, curCol);
+    return reps.size();
+}
+
+/**
+ * Return the matches of `q` in `buf`, reusing the results of earlier queries where possible.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param regex Whether `q` is a regular expression
+ * @param ctl Progress/cancellation shared with another thread, or nullptr
+ * @return The same matches find_all(buf, q, regex) would return (none if cancelled); valid
+ *         until the next call
+ */
+const vector<Match>& SearchState::update(const TextBuffer& buf, const string& q, bool regex, SearchControl* ctl) {
+    Regex compiled(regex ? q : string());
+    return update(buf, q, regex ? &compiled : nullptr, ctl);
+}
+
+/**
+ * SearchState::update with the pattern already compiled.
+ * 
+ * @param buf The text buffer to search
+ * @param q The query string to find
+ * @param re `q` compiled as a regular expression, or nullptr to find it as literal text
+ * @param ctl Progress/cancellation shared with another thread, or nullptr
+ * @return The same matches find_all would return (none if cancelled); valid until the next call
+ */
+const vector<Match>& SearchState::update(const TextBuffer& buf, const string& q, const Regex* re, SearchControl* ctl) {
+    bool regex = re != nullptr;
+    if (buf_ != &buf || version_ != buf.version() || regex_ != regex) {
+        clear();
+        buf_ = &buf;
+        version_ = buf.version();
+        regex_ = regex;
+    }
+    if (regex) {
+        // A longer pattern does not narrow a shorter one, so only the last result is kept
+        if (!levels_.empty() && levels_.back().query == q) return levels_.back().matches;
+        levels_.clear();
+        if (q.empty() || !re->ok()) return none_;
+        Level level;
+        level.query = q;
+        level.matches = collect_occurrences<Match>(buf, [&](size_t first, size_t last, auto emit) { scan_regex(buf, *re, first, last, emit); },
+                                                   [](size_t, int line, int start, int len) { return Match{line, start, len}; }, ctl);
+        if (ctl && ctl->cancel) return none_;
+        levels_.push_back(move(level));
+        return levels_.back().matches;
+    }
+    // Backspace (or any edit that is not an append) falls back to the longest cached prefix
+    while (!levels_.empty() && q.compare(0, levels_.back().query.size(), levels_.back().query) != 0) levels_.pop_back();
+    if (!levels_.empty() && levels_.back().query == q) return levels_.back().matches;
+    if (q.empty() || q.find('\n') != string::npos) return none_;
+
+    Level next;
+    next.query = q;
+    if (levels_.empty()) {
+        next.hits = collect_occurrences<Hit>(buf, [&](size_t first, size_t last, auto emit) { scan_occurrences(buf, q, true, first, last, emit); },
+                                             [](size_t off, int line, int start, int) { return Hit{off, line, start}; }, ctl);
+    } else {
+        // Keep the previous occurrences that continue with the appended text. Their offsets
+        // ascend, so one pass over the document's spans checks them all.
+        const Level& prev = levels_.back();
+        size_t from = prev.query.size();
+        const char* tail = q.data() + from;
+        size_t tailLen = q.size() - from;
+        if (ctl) ctl->total = prev.hits.size();
+        next.hits.reserve(prev.hits.size());
+        vector<pair<const char*, size_t>> spans;
+        buf.for_each_span(0, buf.size(), [&](const char* data, size_t len) { spans.emplace_back(data, len); });
+        size_t si = 0, spanOff = 0, end = 0;
+        for (size_t k = 0; k < prev.hits.size(); ++k) {
+            if (ctl && (k & (FILTER_BATCH - 1)) == 0) {
+                if (ctl->cancel) return none_;
+                ctl->done = k;
+            }
+            const Hit& h = prev.hits[k];
+            size_t at = h.off + from;
+            if (at + tailLen > buf.size()) break;
+            while (at >= spanOff + spans[si].second) spanOff += spans[si++].second;
+            size_t i = 0, sj = si, jOff = spanOff;
+            for (; i < tailLen; ++i) {
+                while (at + i >= jOff + spans[sj].second) jOff += spans[sj++].second;
+                if (spans[sj].first[at + i - jOff] != tail[i]) break;
+            }
+            if (i < tailLen) continue;
+            next.hits.push_back(h);
+            if (ctl && h.off >= end) {
+                ctl->found++;
+                end = h.off + q.size();
+            }
+        }
+    }
+    if (ctl && ctl->cancel) return none_;
+    push(move(next));
+    return levels_.back().matches;
+}
+
+/**
+ * Forget every cached query and its results.
+ */
+void SearchState::clear() {
+    levels_.clear();
+    buf_ = nullptr;
+}
+
+/**
+ * Derive the non-overlapping matches of a new level (greedily, leftmost first, as find_all
+ * does) and put it on top of the stack.
+ * 
+ * @param level The query and all of its occurrences
+ */
+void SearchState::push(Level level) {
+    int len = (int)level.query.size();
+    size_t end = 0;
+    level.matches.reserve(level.hits.size());
+    for (const Hit& h : level.hits) {
+        if (h.off < end) continue;
+        level.matches.push_back(Match{h.line, h.start, len});
+        end = h.off + len;
+    }
+    levels_.push_back(move(level));
+}
+
+BackgroundSearch::~BackgroundSearch() {
+    stop();
+}
+
+/**
+ * Start counting the matches of `q` in `buf` on the worker thread, unless that count is
+ * already running or done. Whatever was being counted before is cancelled first.
+ * 
+ * @param buf The text buffer to search (must stay unchanged while the scan runs)
+ * @param q The query string to find
+ * @param re `q` compiled as a regular expression, or null to find it as literal text; the
+ *           worker shares it
+ */
+void BackgroundSearch::request(const TextBuffer& buf, const string& q, shared_ptr<const Regex> re) {
+    if (active_ && buf_ == &buf && version_ == buf.version() && query_ == q && !re_ == !re) return;
+    stop();
+    buf_ = &buf;
+    version_ = buf.version();
+    query_ = q;
+    re_ = std::move(re);
+    active_ = true;
+    ctl_.cancel = false;
+    ctl_.found = 0;
+    ctl_.done = 0;
+    ctl_.total = 0;
+    finished_ = false;
+    worker_ = thread([this]() {
+        const vector<Match>& result = state_.update(*buf_, query_, re_.get(), &ctl_);
+        if (ctl_.cancel) return;
+        result_ = &result;
+        finished_.store(true, memory_order_release);
+    });
+}
+
+/**
+ * Cancel the scan in progress (if any) and wait for the worker thread to exit.
+ */
+void BackgroundSearch::stop() {
+    ctl_.cancel = true;
+    if (worker_.joinable()) worker_.join();
+    active_ = false;
+}
+
+/**
+ * Report how far the current scan has got.
+ * 
+ * @param found Receives the number of matches found so far
+ * @param fraction Receives the share of the current pass already done, from 0 to 1
+ * @param matches Receives the results once the scan has finished
+ * @return True if the scan has finished and `matches` was set
+ */
+bool BackgroundSearch::poll(size_t& found, double& fraction, const vector<Match>*& matches) const {
+    if (finished_.load(memory_order_acquire)) {
+        matches = result_;
+        found = result_->size();
+        fraction = 1.0;
+        return true;
+    }
+    found = ctl_.found;
+    size_t total = ctl_.total;
+    fraction = total ? min(1.0, (double)ctl_.done / (double)total) : 0.0;
+    return false;
+}
+
 /**
  * Compute prefix width used for rendering line numbers
  * 
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
+#include "textbuffer.h"
 
 using namespace std;
 
+class Regex;
+
 // Match Descriptor for Find/Replace
 struct Match {
     int line;
@@ -12,8 +18,106 @@ struct Match {
     int len;
 };
 
-// Find all occurrences (non-overlapping) of `q` in `lines`
-vector<Match> find_all(const vector<string>& lines, const string& q);
+// Threads a search of a large buffer may use: 0 (the default) for one per core, each with at least
+// 16 MB of text; any other value uses exactly that many for buffers of more than one chunk (4 MB)
+extern size_t g_searchThreads;
+
+// Find all occurrences (non-overlapping) of `q` in `lines`; with `regex`, `q` is a regular
+// expression (see regex.h) and matches may differ in length
+vector<Match> find_all(const TextBuffer& buf, const string& q, bool regex = false);
+
+// The matches find_all would report in lines [first, last) only
+vector<Match> find_in_lines(const TextBuffer& buf, const string& q, size_t first, size_t last, bool regex = false);
+
+// Nearest match starting at/after (next) or before (prev) (line, col), wrapping around the buffer.
+// Cost grows with the distance to the match, not with the size of the buffer.
+bool find_next(const TextBuffer& buf, const string& q, int line, int col, Match& out, bool regex = false);
+bool find_prev(const TextBuffer& buf, const string& q, int line, int col, Match& out, bool regex = false);
+
+// The same searches with the pattern already compiled: `re` is `q` compiled, or nullptr when
+// `q` is literal text. A prompt compiles once per query instead of on every frame or key.
+vector<Match> find_in_lines(const TextBuffer& buf, const string& q, size_t first, size_t last, const Regex* re);
+bool find_next(const TextBuffer& buf, const string& q, int line, int col, Match& out, const Regex* re);
+bool find_prev(const TextBuffer& buf, const string& q, int line, int col, Match& out, const Regex* re);
+
+// Replace every match find_all(buf, q, regex) reports with `repl` ($1-style groups expanded for a
+// regex) in one pass, as a single undo step; (curRow, curCol) is the cursor before. Returns the count.
+size_t replace_all(TextBuffer& buf, const string& q, const string& repl, bool regex, int curRow, int curCol);
+
+// Shared with a search running on another thread: `found` (matches so far) and `done` out of
+// `total` (bytes or occurrences, whichever the current pass works through) report progress,
+// and setting `cancel` makes the search give up early.
+struct SearchControl {
+    atomic<bool> cancel{false};
+    atomic<size_t> found{0};
+    atomic<size_t> done{0};
+    atomic<size_t> total{0};
+};
+
+// Incremental find_all for a query typed one key at a time. Each query prefix keeps every
+// (overlapping) occurrence, so appending text only filters the previous occurrences, Backspace
+// pops back to an earlier result and an unchanged query reuses its result. Any change to the
+// buffer starts over with a full scan.
+class SearchState {
+public:
+    // Same result as find_all(buf, q, regex); with `ctl`, reports progress and can be cancelled.
+    // Regular expressions are not refined incrementally; only the last result is reused.
+    const vector<Match>& update(const TextBuffer& buf, const string& q, bool regex = false, SearchControl* ctl = nullptr);
+    const vector<Match>& update(const TextBuffer& buf, const string& q, const Regex* re, SearchControl* ctl = nullptr);
+
+    // Drop all cached results
+    void clear();
+
+private:
+    struct Hit {
+        size_t off; // byte offset in the document
+        int line;
+        int start;
+    };
+    struct Level {
+        string query;
+        vector<Hit> hits;      // every occurrence of `query`, overlapping ones included
+        vector<Match> matches; // the non-overlapping subset reported to callers
+    };
+
+    vector<Level> levels_; // levels_[i + 1].query extends levels_[i].query
+    const TextBuffer* buf_ = nullptr;
+    uint64_t version_ = 0;
+    bool regex_ = false;
+    vector<Match> none_;
+
+    void push(Level level);
+};
+
+// Counts the matches of a query with SearchState on a worker thread, so the UI can keep reading
+// keys. Asking for a different query (or the same one after an edit) cancels the scan in
+// progress. The buffer must not change while a scan runs: call stop() before editing.
+class BackgroundSearch {
+public:
+    ~BackgroundSearch();
+
+    // Make sure the matches of `q` in `buf` are being (or have been) counted; `re` is `q` compiled,
+    // or null for literal text
+    void request(const TextBuffer& buf, const string& q, shared_ptr<const Regex> re = nullptr);
+
+    // Cancel any scan in progress and wait for the worker to finish
+    void stop();
+
+    // Progress of the current scan; returns true once `matches` has been set to the results
+    bool poll(size_t& found, double& fraction, const vector<Match>*& matches) const;
+
+private:
+    SearchState state_; // used by the worker only while a scan runs
+    SearchControl ctl_;
+    thread worker_;
+    const TextBuffer* buf_ = nullptr;
+    uint64_t version_ = 0;
+    string query_;
+    shared_ptr<const Regex> re_;
+    bool active_ = false;            // a scan was requested since the last stop()
+    atomic<bool> finished_{false};
+    const vector<Match>* result_ = nullptr;
+};
 
 // Compute prefix width used for rendering line numbers
 int compute_prefix_width(bool showLineNumbers, int totalLines);